@@ -0,0 +1,211 @@
+// etch-bench: compile throughput of synthetic sources, per phase and size
+//
+// usage: etch-bench [--opt 0-5] [--max N] [--reps N] [--budget S] [generator...]
+//
+// Each generator is run at sizes 1, 2, 4, ... up to max, and stops growing
+// once a single compile takes longer than the budget in seconds.
+//
+// prints CSV: generator,size,bytes,phase,seconds,bytes_per_second
+
+#include <etch/compiler.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+	using generator = std::function<std::string(size_t)>;
+
+	// f = a -> { { ... a ... } }
+	std::string nested_blocks(size_t n) {
+		std::ostringstream s;
+		s << "f = a -> ";
+		for(size_t i = 0; i < n; ++i) {
+			s << "{ ";
+		}
+		s << 'a';
+		for(size_t i = 0; i < n; ++i) {
+			s << " }";
+		}
+		s << std::endl;
+		return s.str();
+	}
+
+	// f = a -> (a, a + 1, ...)
+	std::string wide_tuple(size_t n) {
+		std::ostringstream s;
+		s << "f = a -> (a";
+		for(size_t i = 1; i < n; ++i) {
+			s << ", a + " << i;
+		}
+		s << ')' << std::endl;
+		return s.str();
+	}
+
+	// f = a -> a + a * a + ...
+	std::string operator_chain(size_t n) {
+		std::ostringstream s;
+		s << "f = a -> a";
+		for(size_t i = 0; i < n; ++i) {
+			s << (i % 2 ? " * a" : " + a");
+		}
+		s << std::endl;
+		return s.str();
+	}
+
+	// d0 = a -> a + 0, d1 = a -> d0 <- a + 1, ...
+	std::string many_definitions(size_t n) {
+		std::ostringstream s;
+		s << "d0 = a -> a + 0" << std::endl;
+		for(size_t i = 1; i < n; ++i) {
+			s << 'd' << i << " = a -> d" << i - 1 << " <- (a + " << i << ')' << std::endl;
+		}
+		return s.str();
+	}
+
+	// m = @{ m = @{ ... z = 1 ... } }
+	std::string nested_modules(size_t n) {
+		std::ostringstream s;
+		for(size_t i = 0; i < n; ++i) {
+			s << "m = @{ z" << i << " = " << i << ' ';
+		}
+		s << "z = 1";
+		for(size_t i = 0; i < n; ++i) {
+			s << " }";
+		}
+		s << std::endl;
+		return s.str();
+	}
+
+	// f = a -> (q -> q + 1) <- ((q -> q + 2) <- ... a)
+	std::string anonymous_functions(size_t n) {
+		std::ostringstream s;
+		s << "f = a -> ";
+		for(size_t i = 0; i < n; ++i) {
+			s << "(q -> q + " << i << ") <- (";
+		}
+		s << 'a';
+		for(size_t i = 0; i < n; ++i) {
+			s << ')';
+		}
+		s << std::endl;
+		return s.str();
+	}
+
+	const std::map<std::string, generator> generators = {
+		{"nested_blocks", nested_blocks},
+		{"wide_tuple", wide_tuple},
+		{"operator_chain", operator_chain},
+		{"many_definitions", many_definitions},
+		{"nested_modules", nested_modules},
+		{"anonymous_functions", anonymous_functions},
+	};
+} // namespace
+
+int main(int argc, char **argv) {
+	auto opt = etch::compiler::opt_level::O2;
+	size_t max = 4096;
+	size_t reps = 3;
+	double budget = 10;
+	std::vector<std::string> names;
+
+	auto usage = [argv] {
+		std::cerr << "usage: " << argv[0] << " [--opt 0-5] [--max N] [--reps N] [--budget S] [generator...]" << std::endl;
+		std::cerr << "generators:";
+		for(auto &[name, gen] : generators) {
+			std::cerr << ' ' << name;
+		}
+		std::cerr << std::endl;
+		return 1;
+	};
+
+	for(int i = 1; i < argc; ++i) {
+		if(!std::strcmp(argv[i], "--opt") && i + 1 < argc) {
+			char *end;
+			auto level = std::strtol(argv[++i], &end, 10);
+			if(end == argv[i] || *end || level < 0 || level > (long)etch::compiler::opt_level::Oz) {
+				return usage();
+			}
+			opt = (etch::compiler::opt_level)level;
+		} else if(!std::strcmp(argv[i], "--max") && i + 1 < argc) {
+			max = std::stoul(argv[++i]);
+		} else if(!std::strcmp(argv[i], "--reps") && i + 1 < argc) {
+			reps = std::stoul(argv[++i]);
+		} else if(!std::strcmp(argv[i], "--budget") && i + 1 < argc) {
+			budget = std::stod(argv[++i]);
+		} else if(generators.count(argv[i])) {
+			names.emplace_back(argv[i]);
+		} else {
+			return usage();
+		}
+	}
+
+	if(names.empty()) {
+		for(auto &[name, gen] : generators) {
+			names.emplace_back(name);
+		}
+	}
+
+	std::cout << "generator,size,bytes,phase,seconds,bytes_per_second" << std::endl;
+
+	for(auto &name : names) {
+		for(size_t n = 1; n <= max; n *= 2) {
+			auto src = generators.at(name)(n);
+
+			// best of reps for every top-level phase
+			std::vector<std::string> order;
+			std::map<std::string, double> best;
+			bool failed = false;
+
+			for(size_t r = 0; r < reps && !failed; ++r) {
+				etch::compiler c;
+				c.tgt = etch::compiler::target::binary;
+				c.opt = opt;
+				// keep every definition so that the backend sees all of it
+				c.cg_opts.internalize = false;
+				c.perf = std::make_shared<etch::counters>();
+
+				try {
+					c.run(src);
+				} catch(std::exception &e) {
+					std::cerr << name << ' ' << n << ": " << e.what() << std::endl;
+					failed = true;
+				}
+
+				std::map<std::string, double> total;
+				for(auto &sm : c.perf->samples) {
+					if(sm.depth == 0) {
+						if(!r && !total.count(sm.name)) {
+							order.emplace_back(sm.name);
+						}
+						total[sm.name] += sm.seconds;
+					}
+				}
+				for(auto &[phase, t] : total) {
+					best[phase] = best.count(phase) ? std::min(best[phase], t) : t;
+				}
+			}
+
+			if(failed) {
+				break;
+			}
+
+			double all = 0;
+			for(auto &phase : order) {
+				auto t = best[phase];
+				all += t;
+				std::cout << name << ',' << n << ',' << src.size() << ',' << phase << ',' << t << ',' << (t > 0 ? src.size() / t : 0) << std::endl;
+			}
+			std::cout << name << ',' << n << ',' << src.size() << ",total," << all << ',' << (all > 0 ? src.size() / all : 0) << std::endl;
+
+			if(all > budget) {
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,238 @@
+// etch-bench-runtime: speed of generated code, per program and opt level
+//
+// usage: etch-bench-runtime [--opt 0-5]... [--calls N] [--reps N]
+//                           [--baseline FILE] [--tolerance T] [program...]
+//
+// Every program defines bench = x -> ... returning an i32; it is compiled
+// in-process onto the JIT and called with x = 0, 1, ... calls - 1. Results of
+// every opt level must agree with the first one.
+//
+// prints CSV: program,opt,calls,ns_per_call,checksum
+//
+// With a baseline (an earlier output of this program), exits non-zero if any
+// program got slower than the baseline by more than the tolerance, e.g. 0.1.
+
+#include <etch/compiler.hpp>
+#include <etch/jit.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+	// arithmetic on scalars and vectors; etch operators all group to the right,
+	// whatever their kind, hence the parentheses
+	const char *arithmetic = R"(
+poly = x -> (x * x * x) + (3 * x * x) + (5 * x) + 7
+bench = x -> poly <- (poly <- (poly <- (x + 1)))
+)";
+
+	const char *vectors = R"(
+i32 = #int <- 32
+v4 = #vec <- (i32, 4)
+axpy = ((a : v4), (x : v4), (y : v4)) -> (a * x) + y
+splat = a -> (a, a, a, a) : v4
+rev = (v : v4) -> #shuffle <- (v, v, (3, 2, 1, 0))
+bench = x -> #extract <- (axpy <- (splat <- x, rev <- (x, x + 1, x + 2, x + 3) : v4, splat <- 7), 1)
+)";
+
+	// tuples passed flattened, in registers and in memory, and returned
+	// directly and through sret
+	const char *tuples = R"(
+pair = a -> (a, a + 1)
+add = (a, b) -> a + b
+swap = (a, b, c, d, e, f, g, h) -> (h, g, f, e, d, c, b, a)
+sum = (a, b, c, d, e, f, g, h) -> a + (b * 2) + (c * 3) + (d * 4) + e + f + g + h
+bench = x -> add <- (pair <- (sum <- (swap <- (swap <- (x, x + 1, x + 2, x + 3, x + 4, x + 5, x + 6, x + 7)))))
+)";
+
+	// c0 = a -> a + 1, c1 = a -> { b0 = a  b1 = (b0 * a) + 3 ... c0 <- b4 }, ...
+	//
+	// each link evaluates a polynomial with odd coefficients, enough work that
+	// the inliner leaves most calls of the chain in place at O2 and O3
+	std::string calls(size_t n) {
+		std::ostringstream s;
+		s << "c0 = a -> a + 1" << std::endl;
+		for(size_t i = 1; i < n; ++i) {
+			s << 'c' << i << " = a -> { b0 = a";
+			for(size_t k = 0; k < 4; ++k) {
+				s << "  b" << k + 1 << " = (b" << k << " * a) + " << 2 * (i + k) + 1;
+			}
+			s << "  c" << i - 1 << " <- b4 }" << std::endl;
+		}
+		s << "bench = x -> c" << n - 1 << " <- x" << std::endl;
+		return s.str();
+	}
+
+	// bench = x -> { g1 = a1 -> { g2 = a2 -> ... g2 <- ((a1 * 2) + 2) } g1 <- ((x * 2) + 1) }
+	//
+	// parse time grows steeply with nesting, so n stays small
+	std::string nested(size_t n) {
+		std::ostringstream s;
+		s << "bench = x -> ";
+		for(size_t i = 1; i <= n; ++i) {
+			s << "{ g" << i << " = a" << i << " -> ";
+		}
+		s << "a" << n << " + 1";
+		for(size_t i = n; i >= 1; --i) {
+			s << " g" << i << " <- ((" << (i > 1 ? "a" + std::to_string(i - 1) : "x") << " * 2) + " << i << ") }";
+		}
+		s << std::endl;
+		return s.str();
+	}
+
+	const std::map<std::string, std::string> programs = {
+		{"arithmetic", arithmetic},
+		{"vectors", vectors},
+		{"tuples", tuples},
+		{"calls", calls(32)},
+		{"nested", nested(4)},
+	};
+
+	const char *opt_names[] = {"O0", "O1", "O2", "O3", "Os", "Oz"};
+
+	// program,opt -> ns_per_call of an earlier run
+	std::map<std::pair<std::string, std::string>, double> read_baseline(const std::string &path) {
+		std::ifstream f(path);
+		if(!f) {
+			std::cerr << "ERROR: cannot open baseline: " << path << std::endl;
+			throw std::runtime_error("cannot open baseline: " + path);
+		}
+
+		std::map<std::pair<std::string, std::string>, double> r;
+		std::string line;
+		std::getline(f, line);
+		while(std::getline(f, line)) {
+			std::istringstream s(line);
+			std::string program, opt, calls, ns;
+			if(std::getline(s, program, ',') && std::getline(s, opt, ',') && std::getline(s, calls, ',') && std::getline(s, ns, ',')) {
+				r[{program, opt}] = std::stod(ns);
+			}
+		}
+		return r;
+	}
+} // namespace
+
+int main(int argc, char **argv) {
+	std::vector<etch::compiler::opt_level> opts;
+	size_t n = 10000000;
+	size_t reps = 5;
+	std::string baseline;
+	double tolerance = 0.1;
+	std::vector<std::string> names;
+
+	auto usage = [argv] {
+		std::cerr << "usage: " << argv[0] << " [--opt 0-5]... [--calls N] [--reps N] [--baseline FILE] [--tolerance T] [program...]" << std::endl;
+		std::cerr << "programs:";
+		for(auto &[name, src] : programs) {
+			std::cerr << ' ' << name;
+		}
+		std::cerr << std::endl;
+		return 1;
+	};
+
+	for(int i = 1; i < argc; ++i) {
+		if(!std::strcmp(argv[i], "--opt") && i + 1 < argc) {
+			char *end;
+			auto opt = std::strtol(argv[++i], &end, 10);
+			if(end == argv[i] || *end || opt < 0 || opt >= (long)std::size(opt_names)) {
+				return usage();
+			}
+			opts.push_back((etch::compiler::opt_level)opt);
+		} else if(!std::strcmp(argv[i], "--calls") && i + 1 < argc) {
+			n = std::stoul(argv[++i]);
+		} else if(!std::strcmp(argv[i], "--reps") && i + 1 < argc) {
+			reps = std::stoul(argv[++i]);
+		} else if(!std::strcmp(argv[i], "--baseline") && i + 1 < argc) {
+			baseline = argv[++i];
+		} else if(!std::strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+			tolerance = std::stod(argv[++i]);
+		} else if(programs.count(argv[i])) {
+			names.emplace_back(argv[i]);
+		} else {
+			return usage();
+		}
+	}
+
+	if(opts.empty()) {
+		opts = {etch::compiler::opt_level::O0, etch::compiler::opt_level::O2, etch::compiler::opt_level::O3};
+	}
+	if(names.empty()) {
+		for(auto &[name, src] : programs) {
+			names.emplace_back(name);
+		}
+	}
+
+	std::map<std::pair<std::string, std::string>, double> base;
+	if(!baseline.empty()) {
+		base = read_baseline(baseline);
+	}
+
+	std::cout << "program,opt,calls,ns_per_call,checksum" << std::endl;
+
+	int status = 0;
+	for(auto &name : names) {
+		bool first = true;
+		uint32_t expected = 0;
+
+		for(auto opt : opts) {
+			etch::compiler c;
+			c.opt = opt;
+			c.cpu = "native";
+
+			// a JIT of its own per opt level, so that nothing is shared
+			etch::jit j(1, c.cg_level());
+			int32_t (*fn)(int32_t);
+			try {
+				c.run(programs.at(name), j);
+				fn = j.lookup<int32_t(int32_t)>({"bench"});
+			} catch(std::exception &e) {
+				std::cerr << name << ' ' << opt_names[(int)opt] << ": " << e.what() << std::endl;
+				status = 1;
+				continue;
+			}
+
+			// the first call compiles it
+			fn(0);
+
+			// best of reps
+			double best = 0;
+			uint32_t sum = 0;
+			for(size_t r = 0; r < reps; ++r) {
+				sum = 0;
+				auto t0 = std::chrono::steady_clock::now();
+				for(size_t i = 0; i < n; ++i) {
+					sum += (uint32_t)fn((int32_t)i);
+				}
+				auto t1 = std::chrono::steady_clock::now();
+				double t = std::chrono::duration<double, std::nano>(t1 - t0).count() / (double)n;
+				best = r ? std::min(best, t) : t;
+			}
+
+			std::cout << name << ',' << opt_names[(int)opt] << ',' << n << ',' << best << ',' << sum << std::endl;
+
+			if(first) {
+				expected = sum;
+				first = false;
+			} else if(sum != expected) {
+				std::cerr << "ERROR: " << name << ' ' << opt_names[(int)opt] << ": checksum " << sum << " differs from " << expected << std::endl;
+				status = 1;
+			}
+
+			auto it = base.find({name, opt_names[(int)opt]});
+			if(it != base.end() && best > it->second * (1 + tolerance)) {
+				std::cerr << "ERROR: " << name << ' ' << opt_names[(int)opt] << ": " << best << " ns per call, baseline " << it->second << std::endl;
+				status = 1;
+			}
+		}
+	}
+
+	return status;
+}
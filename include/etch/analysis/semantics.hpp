@@ -54,6 +54,14 @@ namespace etch::analysis {
 
 			if(x == "int") {
 				r = std::make_shared<ir::intr_int>();
+			} else if(x == "vec") {
+				r = std::make_shared<ir::intr_vec>();
+			} else if(x == "extract") {
+				r = std::make_shared<ir::intr_extract>();
+			} else if(x == "insert") {
+				r = std::make_shared<ir::intr_insert>();
+			} else if(x == "shuffle") {
+				r = std::make_shared<ir::intr_shuffle>();
 			} else {
 				std::ostringstream s;
 				s << "analysis::semantics: unknown intrinsic: " << x;
@@ -0,0 +1,34 @@
+#ifndef ETCH_BATCH_HPP
+#define ETCH_BATCH_HPP 1
+
+#include <etch/compiler.hpp>
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace etch {
+	struct batch_input {
+		std::string name;
+		std::string source;
+	};
+
+	struct batch_result {
+		// position in the inputs
+		size_t index;
+		std::string output;
+		// set instead of output when the input failed to compile
+		std::exception_ptr error;
+	};
+
+	// compiles every input with the settings of proto, each on its own context
+	// and module, on a pool of threads. Larger inputs are started first, and
+	// no input is started while the sources already in flight exceed
+	// max_inflight bytes (a single larger input still runs on its own).
+	// Results are passed to done one at a time, in completion order. If done
+	// throws, no further input is started or passed to it, and the exception
+	// is rethrown once the inputs in flight have finished.
+	void compile_batch(const std::vector<batch_input> &, const compiler &proto, size_t threads, const std::function<void(batch_result)> &done, size_t max_inflight = size_t(256) << 20);
+} // namespace etch
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef ETCH_CACHE_HPP
+#define ETCH_CACHE_HPP 1
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace etch {
+	// content-addressed store of compiler outputs in one directory; entries are
+	// written to a temporary file and renamed into place, so several processes
+	// may share a directory, and the least recently used entries are evicted
+	// once the total size exceeds the limit; temporary files left behind by
+	// writers that died are removed then as well; the directory is scanned
+	// for this on the first write and after that only when the size it had
+	// plus this cache's writes since exceed the limit, so writes from other
+	// processes may take it past the limit until one of them scans it
+	class cache {
+		std::string dir;
+
+		// size of the directory as of the last scan plus writes since
+		std::optional<uint64_t> size;
+
+		void prune();
+	  public:
+		uint64_t limit;
+
+		cache(std::string dir, uint64_t limit = uint64_t(1) << 30);
+
+		std::optional<std::string> get(const std::string &key);
+		void put(const std::string &key, std::string_view data);
+	};
+} // namespace etch
+
+#endif
@@ -2,54 +2,144 @@
 #define ETCH_CODEGEN_HPP 1
 
 #include <etch/ir/types.hpp>
+#include <etch/mangling.hpp>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Verifier.h>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace etch {
 	class codegen {
-		class scope {
-			std::shared_ptr<scope> parent;
-			std::unordered_map<std::string, llvm::Value *> syms;
+	  public:
+		struct options {
+			// tuple arguments with at most this many scalars are passed as
+			// separate parameters, larger ones by readonly pointer
+			size_t abi_flat_args = 6;
+			// tuple results with at most this many scalars are returned in
+			// registers, larger ones through an sret pointer
+			size_t abi_direct_ret = 2;
+			// structurally identical functions share one body; named
+			// duplicates become aliases of it
+			bool merge_functions = true;
+			// definitions not listed in exports (by mangled name) get internal
+			// linkage, and fastcc when their address is never taken; bitcode
+			// for LTO keeps everything unless exports differ from these
+			bool internalize = true;
+			std::unordered_set<std::string> exports = {mangle({"etch", "rt", "entry"}), mangle({"main"})};
+		};
+	  private:
+		// how a function type is lowered to its LLVM signature
+		struct signature {
+			enum class pass { none, direct, flat, indirect };
+
+			llvm::Type *arg = nullptr;
+			llvm::Type *ret = nullptr;
+			pass arg_pass = pass::none;
+			pass ret_pass = pass::none;
+			llvm::FunctionType *fty = nullptr;
+		};
+
+		// module symbols are hashed by name, the symbols of every enclosing
+		// function scope sit on one stack; names point into the IR, which
+		// outlives codegen
+		class symtab {
+			std::vector<std::pair<std::string_view, llvm::Value *>> syms;
+			std::unordered_map<std::string_view, llvm::Value *> globals;
 		  public:
-			scope() = default;
-			scope(std::shared_ptr<scope> parent) : parent(parent) {}
+			size_t open() const {
+				return syms.size();
+			}
+
+			void close(size_t base) {
+				syms.resize(base);
+			}
+
+			void push(std::string_view name, llvm::Value *val) {
+				syms.emplace_back(name, val);
+			}
 
-			void push(std::string name, llvm::Value *val) {
-				syms[name] = val;
+			void push_global(std::string_view name, llvm::Value *val) {
+				globals[name] = val;
 			}
 
-			llvm::Value * find(std::string name) const {
-				auto it = syms.find(name);
-				if(it != syms.end()) {
-					return it->second;
-				} else if(parent) {
-					return parent->find(name);
-				} else {
-					return nullptr;
+			llvm::Value * find(std::string_view name, size_t base) const {
+				for(size_t i = syms.size(); i > base; --i) {
+					if(syms[i - 1].first == name) {
+						return syms[i - 1].second;
+					}
 				}
+				return find_global(name);
+			}
+
+			llvm::Value * find_global(std::string_view name) const {
+				auto it = globals.find(name);
+				return it != globals.end() ? it->second : nullptr;
 			}
 		};
 
 		std::shared_ptr<llvm::LLVMContext> ctx;
 		std::shared_ptr<llvm::Module> m;
 
-		std::shared_ptr<scope> scope_module = std::make_shared<scope>();
+		symtab syms;
+
+		// the definition being generated
+		symbol symbols;
+		symbol *scope = &symbols;
+
+		// top-level definitions are dealt round-robin to `parts` groups; those
+		// outside `part` are only declared, constants along with their value
+		// and functions along with the nested functions later ones may merge
+		// with, so every part makes the choices serial codegen would
+		size_t parts = 1;
+		size_t part = 0;
+		size_t index = 0;
+		bool declare = false;
+
+		llvm::Constant * declaration(ir::ptr<ir::base>);
+		void reserve(ir::ptr<ir::base>);
+		llvm::GlobalValue * aliasee(ir::ptr<ir::base>);
 
-		std::vector<std::string> stack;
+		std::unordered_map<std::string, llvm::Function *> merged;
+		// by function node, empty for those that cannot be merged
+		std::unordered_map<const ir::function *, std::string> keys;
+
+		const std::string & fingerprint(ir::ptr<ir::function>);
+		bool fingerprint(ir::ptr<ir::base>, std::string &, std::unordered_map<std::string_view, size_t> &, bool);
+		template<typename F>
+		std::pair<llvm::Function *, bool> merge(ir::ptr<ir::function>, F);
+
+		signature lower(ir::ptr<ir::function>);
+		llvm::Function * prototype(const signature &, const std::string &);
+		template<typename T>
+		static void annotate(const signature &, T *);
+		llvm::Value * temporary(llvm::IRBuilder<> &, llvm::Type *);
+
+		void flatten(llvm::Type *, std::vector<llvm::Type *> &);
+		void flatten(llvm::IRBuilder<> &, llvm::Value *, std::vector<llvm::Value *> &);
+		llvm::Value * assemble(llvm::IRBuilder<> &, llvm::Type *, llvm::Value * const *&);
+		void bind(llvm::IRBuilder<> &, ir::ptr<ir::base>, llvm::Type *, llvm::Value * const *&);
 	  public:
-		codegen(std::shared_ptr<llvm::LLVMContext> ctx, std::shared_ptr<llvm::Module> m) : ctx(ctx), m(m) {}
+		options opts;
 
-		void bind(std::shared_ptr<scope>, llvm::IRBuilder<> &, ir::ptr<ir::base>, llvm::Value *);
+		codegen(std::shared_ptr<llvm::LLVMContext> ctx, std::shared_ptr<llvm::Module> m, size_t parts = 1, size_t part = 0) : ctx(ctx), m(m), parts(parts), part(part) {}
+
+		void bind(llvm::IRBuilder<> &, ir::ptr<ir::base>, llvm::Value *);
 
 		llvm::Type     * type(ir::ptr<ir::base>);
 		llvm::Constant * constant(ir::ptr<ir::base>);
-		llvm::Function * function(std::string, ir::ptr<ir::function>);
-		llvm::Value    * local(std::shared_ptr<scope>, llvm::IRBuilder<> &, ir::ptr<ir::base>);
+		llvm::Function * function(const std::string &, ir::ptr<ir::function>);
+		llvm::Value    * local(size_t, llvm::IRBuilder<> &, ir::ptr<ir::base>);
 		llvm::Constant * global(ir::ptr<ir::base>);
 
 		void run(ir::ptr<ir::module_>);
 		void run(const ir::unit &);
+
+		// in parallel; workers trace with the given granularity when the
+		// calling thread's time profiler is enabled
+		static void run(llvm::Module &, const ir::unit &, size_t threads, const options &, unsigned trace_granularity);
+		static void finalize(llvm::Module &, const options &);
 	};
 } // namespace etch
 
@@ -1,27 +1,126 @@
 #ifndef ETCH_COMPILER_HPP
 #define ETCH_COMPILER_HPP 1
 
+#include <etch/cache.hpp>
+#include <etch/codegen.hpp>
+#include <etch/counters.hpp>
+#include <etch/jit.hpp>
+#include <etch/multiversion.hpp>
+#include <etch/statistics.hpp>
 #include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
 #include <string_view>
 
 namespace etch {
+	class session;
+
 	class compiler {
 	  public:
 		enum class target {
 			llvm_assembly,
 			assembly,
-			binary
+			binary,
+			bitcode
+		};
+		enum class opt_level {
+			O0,
+			O1,
+			O2,
+			O3,
+			Os,
+			Oz
+		};
+		enum class lto_mode {
+			full,
+			thin
+		};
+		enum class pgo_mode {
+			none,
+			instrument,
+			use
 		};
 	  private:
 		std::shared_ptr<llvm::LLVMContext> ctx = std::make_shared<llvm::LLVMContext>();
 		std::shared_ptr<llvm::Module> m;
+
+		std::pair<std::string, std::string> machine() const;
+		std::string key(std::string_view) const;
+		void generate(std::string_view, const codegen::options &);
+		void verify();
+		void optimize(llvm::TargetMachine &);
+		void emit(std::string_view, llvm::raw_pwrite_stream &);
 	  public:
 		bool debug = false;
 		target tgt = target::binary;
+		opt_level opt = opt_level::O2;
+
+		// flavour of bitcode emitted for target::bitcode; thin modules carry a
+		// summary index and hash for lld's ThinLTO backends and cache
+		lto_mode lto = lto_mode::thin;
+
+		// profile-guided optimization; instrumented code counts function
+		// entries and edges and writes a raw profile to the given path at exit
+		// (with linker::profile; the JIT rejects it), use reads an indexed
+		// profile merged from those with llvm-profdata
+		pgo_mode pgo = pgo_mode::none;
+		std::string profile;
+		// codegen in this many parts at once; the module holds the same
+		// definitions as with one, in another order
+		size_t threads = 1;
+		codegen::options cg_opts;
+
+		// every function and global in a section of its own, plus an
+		// address-significance table, for linker::gc_sections and linker::icf
+		bool sections = false;
+
+		// cpu name and feature string for the target machine; "native" uses
+		// the host's
+		std::string cpu = "generic";
+		std::string features = "";
+
+		multiversion mv;
 
-		compiler(std::string name = "a.e") : m(std::make_shared<llvm::Module>(name, *ctx)) {}
+		// outputs are looked up here by a hash of the source and every setting
+		// above before anything is compiled
+		std::shared_ptr<cache> objects;
+
+		// sizes and memory use are appended here after every phase when set
+		std::shared_ptr<statistics> stats;
+
+		// cycles, instructions, cache and branch misses of every phase and pass
+		// are sampled here when set
+		std::shared_ptr<counters> perf;
+
+		// a Chrome trace event file of every phase, pass and top-level
+		// definition is written here when set; events shorter than the
+		// granularity (in microseconds) are left out. Traced compiles in a
+		// process run one at a time, e.g. in compile_batch
+		std::string time_trace;
+		unsigned time_trace_granularity = 500;
+
+		// target machines come from here, or from session::shared() if unset
+		session *sess = nullptr;
+
+		// module name of every compile
+		std::string name;
+
+		compiler(std::string name = "a.e") : m(std::make_shared<llvm::Module>(name, *ctx)), name(name) {}
 
 		std::string run(std::string_view);
+
+		// output goes straight into the given sink; fds need not be seekable
+		void run(std::string_view, llvm::raw_pwrite_stream &);
+		void run(std::string_view, int fd);
+		void run(std::string_view, llvm::SmallVectorImpl<char> &);
+		std::unique_ptr<llvm::MemoryBuffer> run_buffer(std::string_view);
+
+		// backend optimization level matching opt
+		llvm::CodeGenOpt::Level cg_level() const;
+
+		// definitions are optimized at opt for the host before they are added
+		void run(std::string_view, jit &);
 	};
 } // namespace etch
 
@@ -0,0 +1,79 @@
+#ifndef ETCH_COUNTERS_HPP
+#define ETCH_COUNTERS_HPP 1
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace etch {
+	// hardware performance counters read around compiler phases and passes
+	// (perf_event_open on Linux). They count the thread that created them and
+	// the threads it starts afterwards, e.g. for parallel codegen, once those
+	// have exited; scopes may only be opened on that thread, so concurrent
+	// compiles need counters of their own, see merge. Counts are scaled up by
+	// the share of time they were counted when the kernel multiplexes more
+	// events than the PMU has counters. When counters cannot be opened, only
+	// wall time is recorded.
+	class counters {
+	  public:
+		enum event { cycles, instructions, cache_misses, branch_misses, num_events };
+
+		struct sample {
+			std::string name;
+			size_t depth;
+			double seconds;
+			std::array<uint64_t, num_events> values;
+		};
+	  private:
+		using clock = std::chrono::steady_clock;
+
+		// as read from the kernel: the count and for how long the event was
+		// enabled and actually counting, in nanoseconds
+		struct count {
+			uint64_t value = 0;
+			uint64_t enabled = 0;
+			uint64_t running = 0;
+		};
+
+		struct reading {
+			clock::time_point time;
+			std::array<count, num_events> counts;
+		};
+
+		std::array<int, num_events> fds;
+		std::vector<std::pair<size_t, reading>> open;
+		std::thread::id owner;
+		mutable std::mutex mtx;
+
+		reading read() const;
+		void check() const;
+	  public:
+		// complete once every scope has ended
+		std::vector<sample> samples;
+
+		counters();
+		counters(const counters &) = delete;
+		counters & operator=(const counters &) = delete;
+		~counters();
+
+		bool available(event e) const {
+			return fds[e] >= 0;
+		}
+
+		// scopes nest; end closes the innermost one
+		void begin(std::string name);
+		void end();
+
+		// appends the samples of another, e.g. from another thread
+		void merge(const counters &);
+
+		std::ostream & dump(std::ostream &s = std::cout) const;
+	};
+} // namespace etch
+
+#endif
@@ -108,11 +108,31 @@ namespace etch::ir {
 		}
 	};
 
+	struct type_vec : base {
+		ptr<base> el;
+		size_t lanes;
+
+		type_vec(ptr<base> el, size_t lanes) : el(el), lanes(lanes) {}
+
+		ptr<base> type() const {
+			return std::make_shared<type_type>();
+		}
+
+		std::ostream & dump_impl(std::ostream &s, size_t depth = 0) const override {
+			s << "(type_vec " << lanes << ' ';
+			el->dump_impl(s, depth);
+			return s << ')';
+		}
+	};
+
 	struct constant_int : base {
 		int32_t val;
 		size_t width;
 
-		constant_int(int32_t val, size_t width = 32) : val(val), width(width) {}
+		// literals without a cast take their width from where they are used
+		bool sized;
+
+		constant_int(int32_t val, size_t width = 32, bool sized = false) : val(val), width(width), sized(sized) {}
 
 		ptr<base> type() const {
 			return std::make_shared<type_int>(width);
@@ -123,6 +143,25 @@ namespace etch::ir {
 		}
 	};
 
+	struct constant_vec : base {
+		std::vector<int32_t> vals;
+		size_t width;
+
+		constant_vec(std::vector<int32_t> vals, size_t width = 32) : vals(vals), width(width) {}
+
+		ptr<base> type() const {
+			return std::make_shared<type_vec>(std::make_shared<type_int>(width), vals.size());
+		}
+
+		std::ostream & dump_impl(std::ostream &s, size_t depth = 0) const override {
+			s << "(constant_vec";
+			for(auto &val : vals) {
+				s << ' ' << val;
+			}
+			return s << ')';
+		}
+	};
+
 	struct identifier : base {
 	  private:
 		ptr<base> resolved;
@@ -238,6 +277,11 @@ namespace etch::ir {
 		}
 	};
 
+	// intrinsics whose result type depends on their argument
+	struct intr_generic : base {
+		virtual ptr<base> result(ptr<base> arg) const = 0;
+	};
+
 	struct call : base {
 		ptr<base> fn;
 		ptr<base> arg;
@@ -245,7 +289,9 @@ namespace etch::ir {
 		call(ptr<base> fn, ptr<base> arg) : fn(fn), arg(arg) {}
 
 		ptr<base> type() const {
-			if(auto fty = as<function>(fn->type())) {
+			if(auto intr = as<intr_generic>(fn)) {
+				return intr->result(arg);
+			} else if(auto fty = as<function>(fn->type())) {
 				return fty->body;
 			} else {
 				return std::make_shared<type_unresolved>();
@@ -288,7 +334,24 @@ namespace etch::ir {
 		}
 	};
 
-	struct intr_binop : base {
+	struct intr_vec : base {
+		ptr<base> type() const {
+			auto tyty = std::make_shared<type_type>();
+
+			auto tty = std::make_shared<tuple>();
+			tty->push_back(tyty);
+			tty->push_back(std::make_shared<type_int>(32));
+
+			return std::make_shared<function>(tty, tyty);
+		}
+
+		std::ostream & dump_impl(std::ostream &s, size_t depth = 0) const override {
+			return s << "(intr_vec)";
+		}
+	};
+
+	// element-wise on vectors, so the result has the type of the lhs
+	struct intr_binop : intr_generic {
 		ptr<base> type() const {
 			auto ity = std::make_shared<type_int>(32);
 
@@ -298,6 +361,15 @@ namespace etch::ir {
 
 			return std::make_shared<function>(tty, ity);
 		}
+
+		ptr<base> result(ptr<base> arg) const override {
+			auto t = as<tuple>(arg);
+			if(t && !t->vals.empty()) {
+				return t->vals[0]->type();
+			} else {
+				return std::make_shared<type_int>(32);
+			}
+		}
 	};
 
 	struct intr_add : intr_binop {
@@ -312,6 +384,87 @@ namespace etch::ir {
 		}
 	};
 
+	// lane operations on vectors: (vec, lane), (vec, lane, val) and
+	// (vec, vec, (lanes...))
+	struct intr_lane : intr_generic {
+		ptr<base> type() const {
+			auto any = std::make_shared<type_any>();
+			return std::make_shared<function>(any, any);
+		}
+
+		static ptr<base> vec(ptr<base> arg) {
+			auto t = as<tuple>(arg);
+			return t && !t->vals.empty() ? t->vals[0]->type() : nullptr;
+		}
+	};
+
+	struct intr_extract : intr_lane {
+		ptr<base> result(ptr<base> arg) const override {
+			if(auto ty = as<type_vec>(vec(arg))) {
+				return ty->el;
+			} else {
+				return std::make_shared<type_unresolved>();
+			}
+		}
+
+		std::ostream & dump_impl(std::ostream &s, size_t depth = 0) const override {
+			return s << "(intr_extract)";
+		}
+	};
+
+	struct intr_insert : intr_lane {
+		ptr<base> result(ptr<base> arg) const override {
+			if(auto ty = as<type_vec>(vec(arg))) {
+				return ty;
+			} else {
+				return std::make_shared<type_unresolved>();
+			}
+		}
+
+		std::ostream & dump_impl(std::ostream &s, size_t depth = 0) const override {
+			return s << "(intr_insert)";
+		}
+	};
+
+	struct intr_shuffle : intr_lane {
+		static std::vector<int> mask(ptr<base> arg) {
+			std::vector<int> r;
+
+			auto t = as<tuple>(arg);
+			if(!t || t->vals.size() != 3) {
+				return r;
+			}
+
+			if(auto c = as<constant_int>(t->vals[2])) {
+				r.push_back(c->val);
+			} else if(auto lanes = as<tuple>(t->vals[2])) {
+				for(auto &lane : lanes->vals) {
+					auto c = as<constant_int>(lane);
+					if(!c) {
+						return {};
+					}
+					r.push_back(c->val);
+				}
+			}
+
+			return r;
+		}
+
+		ptr<base> result(ptr<base> arg) const override {
+			auto ty = as<type_vec>(vec(arg));
+			auto lanes = mask(arg);
+			if(ty && !lanes.empty()) {
+				return std::make_shared<type_vec>(ty->el, lanes.size());
+			} else {
+				return std::make_shared<type_unresolved>();
+			}
+		}
+
+		std::ostream & dump_impl(std::ostream &s, size_t depth = 0) const override {
+			return s << "(intr_shuffle)";
+		}
+	};
+
 	struct unit {
 		std::vector<ptr<ir::module_>> modules;
 
@@ -0,0 +1,32 @@
+#ifndef ETCH_JIT_HPP
+#define ETCH_JIT_HPP 1
+
+#include <etch/mangling.hpp>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/Module.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace etch {
+	// in-process execution on ORC; functions are compiled lazily on their first
+	// call, one function per partition
+	class jit {
+		std::unique_ptr<llvm::orc::LLLazyJIT> lljit;
+	  public:
+		// level is the backend's; IR is optimized by the compiler beforehand
+		jit(size_t threads = 1, llvm::CodeGenOpt::Level level = llvm::CodeGenOpt::Default);
+
+		void add(const llvm::Module &);
+
+		uint64_t address(const std::string &);
+
+		// T is the lowered signature, e.g. int32_t(int32_t)
+		template <typename T>
+		T * lookup(std::vector<std::string> names) {
+			return reinterpret_cast<T *>(address(mangle(std::move(names))));
+		}
+	};
+} // namespace etch
+
+#endif
@@ -1,18 +1,80 @@
 #ifndef ETCH_LINKER_HPP
 #define ETCH_LINKER_HPP 1
 
+#include <llvm/Support/MemoryBuffer.h>
+#include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace etch {
 	class linker {
 		std::vector<std::string> inputs;
+		std::vector<std::unique_ptr<llvm::MemoryBuffer>> buffers;
+
+		void link(const std::string &output);
 	  public:
+		// inputs may be objects or bitcode from compiler::target::bitcode;
+		// bitcode inputs are optimized together at the given level
+		unsigned lto_opt = 2;
+
+		// ThinLTO backend threads, 0 lets lld decide
+		size_t lto_jobs = 0;
+
+		// ThinLTO cache directory, disabled when empty
+		std::string lto_cache;
+
+		// links the bundled runtime, see etch/rt.hpp, and its entry point into
+		// a static executable; otherwise libc and its start files among the
+		// inputs enter it, through a main calling etch's; ELF only
+		bool runtime = true;
+
+		// directory holding libetch-rt.a and libetch-rt-libc.a, e.g. where
+		// they were installed; empty uses ETCH_RT_DIR as etch was built
+		std::string runtime_dir;
+
+		// links the profile runtime for code from compiler::pgo_mode::instrument;
+		// it writes the profile from an atexit handler, so it needs libc and
+		// its start files among the inputs instead of the bundled runtime; ELF
+		// only
+		bool profile = false;
+
+		// threads of lld's own parallel passes, 0 lets lld decide
+		size_t threads = 0;
+
+		// drop sections nothing refers to, and fold identical ones whose
+		// address is never taken; objects need compiler::sections for either
+		bool gc_sections = false;
+		bool icf = false;
+
+		// what the above removed from objects; bitcode is compiled inside lld
+		// and not counted
+		struct report {
+			size_t gc_sections = 0;
+			size_t gc_bytes = 0;
+			size_t icf_sections = 0;
+			size_t icf_bytes = 0;
+
+			std::ostream & dump(std::ostream &s = std::cout) const;
+		};
+
+		// ELF only; filled in by every link when set
+		std::shared_ptr<report> removed;
+
 		void push_back(std::string input) {
 			inputs.emplace_back(input);
 		}
 
+		// e.g. from compiler::run_buffer; ELF only, the buffers are handed to
+		// lld without being written to disk
+		void push_back(std::unique_ptr<llvm::MemoryBuffer> input) {
+			buffers.emplace_back(std::move(input));
+		}
+
 		void run(std::string = "a.out");
+
+		// ELF only; the executable is linked in memory
+		std::unique_ptr<llvm::MemoryBuffer> run_buffer();
 	};
 } // namespace etch
 
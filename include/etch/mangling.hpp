@@ -1,11 +1,52 @@
 #ifndef ETCH_MANGLING_HPP
 #define ETCH_MANGLING_HPP 1
 
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace etch {
-	std::string mangle(std::vector<std::string>);
+	std::string mangle(const std::vector<std::string> &);
+
+	// inverse of mangle; nullopt for names that are not etch symbols
+	std::optional<std::vector<std::string>> demangle(std::string_view);
+
+	// one node per nested scope, the root being the empty path; mangled names
+	// are built once when a node is first entered and live as long as the root
+	class symbol {
+		symbol *parent = nullptr;
+		std::string mangled;
+		std::string_view name;
+		size_t anonymous_count = 0;
+		std::unordered_map<std::string_view, std::unique_ptr<symbol>> children;
+
+		symbol(symbol *parent, std::string_view name);
+	  public:
+		symbol();
+		symbol(const symbol &) = delete;
+		symbol & operator=(const symbol &) = delete;
+
+		symbol * child(std::string_view);
+
+		// anonymous scopes are numbered in order of appearance within their
+		// parent; identifiers never start with a digit, so these cannot clash
+		symbol * anonymous();
+
+		symbol * up() const {
+			return parent;
+		}
+
+		bool root() const {
+			return !parent;
+		}
+
+		const std::string & str() const {
+			return mangled;
+		}
+	};
 } // namespace etch
 
 #endif
@@ -0,0 +1,40 @@
+#ifndef ETCH_MULTIVERSION_HPP
+#define ETCH_MULTIVERSION_HPP 1
+
+#include <llvm/ADT/Triple.h>
+#include <llvm/IR/Module.h>
+#include <string>
+#include <vector>
+
+namespace etch {
+	// clones functions once per ISA level and dispatches between them through
+	// an ifunc whose resolver runs once at load time
+	class multiversion {
+		std::vector<std::string> functions;
+	  public:
+		std::vector<std::string> levels = {"x86-64-v2", "x86-64-v3", "x86-64-v4"};
+
+		// cpu of the default body, taken when no level is supported
+		std::string baseline = "x86-64";
+
+		void push_back(std::string fn) {
+			functions.emplace_back(fn);
+		}
+
+		bool empty() const {
+			return functions.empty();
+		}
+
+		auto begin() const {
+			return functions.begin();
+		}
+
+		auto end() const {
+			return functions.end();
+		}
+
+		void run(llvm::Module &, const llvm::Triple &);
+	};
+} // namespace etch
+
+#endif
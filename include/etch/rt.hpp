@@ -0,0 +1,23 @@
+#ifndef ETCH_RT_HPP
+#define ETCH_RT_HPP 1
+
+// the bundled runtime; freestanding, on raw Linux system calls. linker links
+// it into every executable, whose entry point it provides: that sets up the
+// arguments, runs main = () -> ... and exits with its result
+//
+// the names are the mangled etch.rt.* ones, so that etch code can define any
+// of them itself
+
+extern "C" {
+	int etch_rt_argc() __asm__("etch.1.etch.rt.argc");
+	char ** etch_rt_argv() __asm__("etch.1.etch.rt.argv");
+	char ** etch_rt_envp() __asm__("etch.1.etch.rt.envp");
+
+	// the system call's result, or minus errno
+	long etch_rt_read(int fd, void *buf, unsigned long size) __asm__("etch.1.etch.rt.read");
+	long etch_rt_write(int fd, const void *buf, unsigned long size) __asm__("etch.1.etch.rt.write");
+
+	[[noreturn]] void etch_rt_exit(int status) __asm__("etch.1.etch.rt.exit");
+}
+
+#endif
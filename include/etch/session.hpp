@@ -0,0 +1,65 @@
+#ifndef ETCH_SESSION_HPP
+#define ETCH_SESSION_HPP 1
+
+#include <etch/compiler.hpp>
+#include <llvm/Target/TargetMachine.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace etch {
+	// state shared by many compiles: targets are registered once and target
+	// machines are kept for reuse per configuration
+	class session {
+		std::mutex mtx;
+		std::unordered_map<std::string, std::vector<std::unique_ptr<llvm::TargetMachine>>> idle;
+	  public:
+		// exclusive use of a target machine, which goes back to the session
+		// when the lease ends
+		class lease {
+			session *s;
+			std::string key;
+			std::unique_ptr<llvm::TargetMachine> tm;
+		  public:
+			lease(session *s, std::string key, std::unique_ptr<llvm::TargetMachine> tm) : s(s), key(std::move(key)), tm(std::move(tm)) {}
+			lease(lease &&) = default;
+			~lease();
+
+			llvm::TargetMachine & operator*() const {
+				return *tm;
+			}
+
+			llvm::TargetMachine * operator->() const {
+				return tm.get();
+			}
+		};
+
+		// larger requests to serve() are answered with an error and the
+		// connection is closed
+		size_t max_request = size_t(64) << 20;
+
+		session();
+		session(const session &) = delete;
+		session & operator=(const session &) = delete;
+
+		// used by compilers not created through a session
+		static session & shared();
+
+		lease acquire(const std::string &triple, const std::string &cpu, const std::string &features, llvm::CodeGenOpt::Level);
+
+		compiler job(std::string name = "a.e");
+
+		// compile daemon on a Unix domain socket; each request is
+		//   uint8_t target, uint8_t opt_level, uint64_t size, source
+		// and each response
+		//   uint8_t status (0 = ok), uint64_t size, output or error message
+		// in native byte order. Does not return.
+		void serve(const std::string &path, size_t threads = 1);
+
+		static std::string request(const std::string &path, compiler::target, compiler::opt_level, std::string_view);
+	};
+} // namespace etch
+
+#endif
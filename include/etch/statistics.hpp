@@ -0,0 +1,53 @@
+#ifndef ETCH_STATISTICS_HPP
+#define ETCH_STATISTICS_HPP 1
+
+#include <etch/ir/types.hpp>
+#include <llvm/IR/Module.h>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace etch {
+	// sizes and memory use recorded after each compiler phase; not for
+	// concurrent compiles, compile_batch records each input separately and
+	// merges them
+	struct statistics {
+		struct phase {
+			std::string name;
+
+			// process heap in use and peak resident set, in bytes
+			size_t heap = 0;
+			size_t peak_rss = 0;
+
+			// IR phases: reachable nodes by kind and their approximate size
+			std::map<std::string, size_t> nodes;
+			size_t node_bytes = 0;
+
+			// transforms: nodes visited and nodes replaced by a different one
+			size_t visited = 0;
+			size_t rewritten = 0;
+
+			// LLVM phases
+			size_t globals = 0;
+			size_t functions = 0;
+			size_t blocks = 0;
+			size_t instructions = 0;
+		};
+
+		std::vector<phase> phases;
+
+		phase & record(std::string name);
+
+		// appends the phases of another
+		void merge(const statistics &);
+
+		static void count(phase &, const ir::unit &);
+		static void count(phase &, const llvm::Module &);
+
+		std::ostream & dump(std::ostream &s = std::cout) const;
+		std::ostream & json(std::ostream &s) const;
+	};
+} // namespace etch
+
+#endif
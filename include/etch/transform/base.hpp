@@ -12,12 +12,20 @@ namespace etch::transform {
 
 		void bind(ir::ptr<ir::base> binding, ir::ptr<ir::base> val) {
 			if(auto id = ir::as<ir::identifier>(binding)) {
-				id->resolve(std::make_shared<ir::type_int>(32));
+				// the type is left to inference
 				stack.back().syms.emplace(id->str, val);
 			} else if(auto tuple = ir::as<ir::tuple>(binding)) {
 				for(auto &val : tuple->vals) {
 					bind(val);
 				}
+			} else if(auto typed = ir::as<ir::cast>(binding)) {
+				auto id = ir::as<ir::identifier>(typed->val);
+				if(!id) {
+					return bind(typed->val, val);
+				}
+
+				id->resolve(typed->ty);
+				stack.back().syms.emplace(id->str, val);
 			} else {
 				std::ostringstream s;
 				s << "analysis::resolution: unhandled binding: ";
@@ -33,6 +41,10 @@ namespace etch::transform {
 			return bind(binding, binding);
 		}
 	  protected:
+		// set while the names in a function's argument are visited, which are
+		// being bound rather than referred to
+		bool binding = false;
+
 		ir::ptr<ir::base> lookup(std::string name) const {
 			for(auto it = stack.rbegin(); it != stack.rend(); ++it) {
 				auto search = it->syms.find(name);
@@ -44,6 +56,7 @@ namespace etch::transform {
 		}
 
 		virtual ir::ptr<ir::base> visit(ir::ptr<ir::constant_int>    x) { return x; }
+		virtual ir::ptr<ir::base> visit(ir::ptr<ir::constant_vec>    x) { return x; }
 		virtual ir::ptr<ir::base> visit(ir::ptr<ir::identifier>      x) { return x; }
 		virtual ir::ptr<ir::base> visit(ir::ptr<ir::call>            x) { return x; }
 		virtual ir::ptr<ir::base> visit(ir::ptr<ir::definition>      x) { return x; }
@@ -55,15 +68,24 @@ namespace etch::transform {
 		virtual ir::ptr<ir::base> visit(ir::ptr<ir::intr_int>        x) { return x; }
 		virtual ir::ptr<ir::base> visit(ir::ptr<ir::intr_add>        x) { return x; }
 		virtual ir::ptr<ir::base> visit(ir::ptr<ir::intr_mul>        x) { return x; }
+		virtual ir::ptr<ir::base> visit(ir::ptr<ir::intr_vec>        x) { return x; }
+		virtual ir::ptr<ir::base> visit(ir::ptr<ir::intr_extract>    x) { return x; }
+		virtual ir::ptr<ir::base> visit(ir::ptr<ir::intr_insert>     x) { return x; }
+		virtual ir::ptr<ir::base> visit(ir::ptr<ir::intr_shuffle>    x) { return x; }
 
 		virtual ir::ptr<ir::base> visit(ir::ptr<ir::cast>            x) { return x; }
 
 		virtual ir::ptr<ir::base> visit(ir::ptr<ir::type_type>       x) { return x; }
 		virtual ir::ptr<ir::base> visit(ir::ptr<ir::type_unresolved> x) { return x; }
 		virtual ir::ptr<ir::base> visit(ir::ptr<ir::type_int>        x) { return x; }
+		virtual ir::ptr<ir::base> visit(ir::ptr<ir::type_vec>        x) { return x; }
 
 		virtual ir::ptr<ir::base> post(ir::ptr<ir::base> x) { return x; }
 	  public:
+		// nodes seen, and nodes whose visit returned a different node
+		size_t visited = 0;
+		size_t rewritten = 0;
+
 		ir::ptr<ir::base> run(ir::ptr<ir::base> val) {
 			if(val == nullptr) { return val; }
 
@@ -71,6 +93,8 @@ namespace etch::transform {
 
 			if(auto x = ir::as<ir::constant_int>(val)) {
 				r = visit(x);
+			} else if(auto x = ir::as<ir::constant_vec>(val)) {
+				r = visit(x);
 			} else if(auto x = ir::as<ir::identifier>(val)) {
 				r = visit(x);
 			} else if(auto x = ir::as<ir::call>(val)) {
@@ -98,7 +122,9 @@ namespace etch::transform {
 			} else if(auto x = ir::as<ir::function>(val)) {
 				stack.emplace_back(scope{});
 
+				binding = true;
 				x->arg  = run(x->arg);
+				binding = false;
 				bind(x->arg);
 				x->body = run(x->body);
 
@@ -120,8 +146,20 @@ namespace etch::transform {
 				r = visit(x);
 			} else if(auto x = ir::as<ir::intr_mul>(val)) {
 				r = visit(x);
+			} else if(auto x = ir::as<ir::intr_vec>(val)) {
+				r = visit(x);
+			} else if(auto x = ir::as<ir::intr_extract>(val)) {
+				r = visit(x);
+			} else if(auto x = ir::as<ir::intr_insert>(val)) {
+				r = visit(x);
+			} else if(auto x = ir::as<ir::intr_shuffle>(val)) {
+				r = visit(x);
 			} else if(auto x = ir::as<ir::cast>(val)) {
+				// the type of a typed binding is an ordinary reference
+				auto b = binding;
+				binding = false;
 				x->ty  = run(x->ty);
+				binding = b;
 				x->val = run(x->val);
 				r = visit(x);
 			} else if(ir::as<ir::type_type>(val)) {
@@ -130,6 +168,9 @@ namespace etch::transform {
 				r = visit(x);
 			} else if(auto x = ir::as<ir::type_int>(val)) {
 				r = visit(x);
+			} else if(auto x = ir::as<ir::type_vec>(val)) {
+				x->el = run(x->el);
+				r = visit(x);
 			} else {
 				std::ostringstream s;
 				s << "transform::base: unhandled value: ";
@@ -140,6 +181,11 @@ namespace etch::transform {
 				throw std::runtime_error(s.str());
 			}
 
+			++visited;
+			if(r != val) {
+				++rewritten;
+			}
+
 			return r;
 		}
 
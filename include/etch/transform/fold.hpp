@@ -2,10 +2,62 @@
 #define ETCH_TRANSFORM_FOLD_HPP 1
 
 #include <etch/transform/base.hpp>
+#include <sstream>
 
 namespace etch::transform {
 	class fold : public base {
+		[[noreturn]] static void fail(const char *what, ir::ptr<ir::base> val) {
+			std::ostringstream s;
+			s << "transform::fold: " << what << " in:" << std::endl;
+			val->dump(s);
+			auto str = s.str();
+
+			std::cerr << str << std::endl << std::endl;
+			throw std::runtime_error(s.str());
+		}
+
+		// lane literals may be written signed or unsigned, but must not lose
+		// bits to the element width
+		static bool fits(int32_t val, size_t width) {
+			return width >= 32 || (val >= -(int64_t(1) << (width - 1)) && val < (int64_t(1) << width));
+		}
+
+		template<typename F>
+		static ir::ptr<ir::base> binop(ir::ptr<ir::tuple> t, F f) {
+			ir::ptr<ir::base> r = nullptr;
+
+			if(!t || t->vals.size() != 2) {
+				return r;
+			}
+
+			if(auto lhs = ir::as<ir::constant_int>(t->vals[0])) {
+				if(auto rhs = ir::as<ir::constant_int>(t->vals[1])) {
+					auto &sized = lhs->sized ? lhs : rhs;
+					r = std::make_shared<ir::constant_int>(f(lhs->val, rhs->val), sized->width, sized->sized);
+				}
+			} else if(auto lhs = ir::as<ir::constant_vec>(t->vals[0])) {
+				auto rhs = ir::as<ir::constant_vec>(t->vals[1]);
+				if(rhs && lhs->vals.size() == rhs->vals.size()) {
+					std::vector<int32_t> vals;
+					for(size_t i = 0; i < lhs->vals.size(); ++i) {
+						vals.push_back(f(lhs->vals[i], rhs->vals[i]));
+					}
+					r = std::make_shared<ir::constant_vec>(vals, lhs->width);
+				}
+			}
+
+			return r;
+		}
 	  public:
+		ir::ptr<ir::base> visit(ir::ptr<ir::identifier> x) override {
+			// types resolved before folding may still refer to unfolded calls
+			if(auto find = binding ? nullptr : lookup(x->str)) {
+				x->resolve(find->type());
+			}
+
+			return x;
+		}
+
 		ir::ptr<ir::base> visit(ir::ptr<ir::call> x) override {
 			ir::ptr<ir::base> r = x;
 
@@ -17,16 +69,55 @@ namespace etch::transform {
 					r = std::make_shared<ir::type_int>(c->val);
 				}
 			} else if(auto intr = ir::as<ir::intr_add>(x->fn)) {
-				auto lhs = ir::as<ir::constant_int>(t->vals[0]);
-				auto rhs = ir::as<ir::constant_int>(t->vals[1]);
-				if(lhs && rhs) {
-					r = std::make_shared<ir::constant_int>(lhs->val + rhs->val);
+				if(auto c = binop(t, [](int32_t a, int32_t b) { return a + b; })) {
+					r = c;
 				}
 			} else if(auto intr = ir::as<ir::intr_mul>(x->fn)) {
-				auto lhs = ir::as<ir::constant_int>(t->vals[0]);
-				auto rhs = ir::as<ir::constant_int>(t->vals[1]);
-				if(lhs && rhs) {
-					r = std::make_shared<ir::constant_int>(lhs->val * rhs->val);
+				if(auto c = binop(t, [](int32_t a, int32_t b) { return a * b; })) {
+					r = c;
+				}
+			} else if(!t) {
+				// the lane intrinsics all take a tuple
+			} else if(auto intr = ir::as<ir::intr_vec>(x->fn)) {
+				auto el = t->vals.size() == 2 ? ir::as<ir::type_int>(t->vals[0]) : nullptr;
+				auto lanes = t->vals.size() == 2 ? ir::as<ir::constant_int>(t->vals[1]) : nullptr;
+				if(el && lanes && lanes->val > 0) {
+					r = std::make_shared<ir::type_vec>(el, lanes->val);
+				}
+			} else if(auto intr = ir::as<ir::intr_extract>(x->fn)) {
+				auto v = t->vals.size() == 2 ? ir::as<ir::constant_vec>(t->vals[0]) : nullptr;
+				auto lane = v ? ir::as<ir::constant_int>(t->vals[1]) : nullptr;
+				if(v && lane && (size_t)lane->val < v->vals.size()) {
+					r = std::make_shared<ir::constant_int>(v->vals[lane->val], v->width, true);
+				}
+			} else if(auto intr = ir::as<ir::intr_insert>(x->fn)) {
+				auto v = t->vals.size() == 3 ? ir::as<ir::constant_vec>(t->vals[0]) : nullptr;
+				auto lane = v ? ir::as<ir::constant_int>(t->vals[1]) : nullptr;
+				auto el = v ? ir::as<ir::constant_int>(t->vals[2]) : nullptr;
+				if(v && lane && el && (size_t)lane->val < v->vals.size()) {
+					if(!fits(el->val, v->width)) {
+						fail("inserted literal does not fit the lanes", x);
+					}
+					auto vals = v->vals;
+					vals[lane->val] = el->val;
+					r = std::make_shared<ir::constant_vec>(vals, v->width);
+				}
+			} else if(auto intr = ir::as<ir::intr_shuffle>(x->fn)) {
+				auto mask = ir::intr_shuffle::mask(t);
+				auto lhs = !mask.empty() ? ir::as<ir::constant_vec>(t->vals[0]) : nullptr;
+				auto rhs = !mask.empty() ? ir::as<ir::constant_vec>(t->vals[1]) : nullptr;
+				if(lhs && rhs && !mask.empty()) {
+					auto both = lhs->vals;
+					both.insert(both.end(), rhs->vals.begin(), rhs->vals.end());
+
+					std::vector<int32_t> vals;
+					for(auto lane : mask) {
+						if(lane < 0 || (size_t)lane >= both.size()) {
+							return r;
+						}
+						vals.push_back(both[lane]);
+					}
+					r = std::make_shared<ir::constant_vec>(vals, lhs->width);
 				}
 			}
 
@@ -70,7 +161,29 @@ namespace etch::transform {
 
 			if(auto ty_int = ir::as<ir::type_int>(x->ty)) {
 				if(auto val_int = ir::as<ir::constant_int>(x->val)) {
-					r = std::make_shared<ir::constant_int>(val_int->val, ty_int->width);
+					r = std::make_shared<ir::constant_int>(val_int->val, ty_int->width, true);
+				}
+			} else if(auto ty_vec = ir::as<ir::type_vec>(x->ty)) {
+				auto ty_el = ir::as<ir::type_int>(ty_vec->el);
+
+				std::vector<int32_t> vals;
+				if(auto val_int = ir::as<ir::constant_int>(x->val)) {
+					vals.assign(ty_vec->lanes, val_int->val);
+				} else if(auto tuple = ir::as<ir::tuple>(x->val)) {
+					for(auto &val : tuple->vals) {
+						if(auto val_int = ir::as<ir::constant_int>(val)) {
+							vals.push_back(val_int->val);
+						}
+					}
+				}
+
+				if(ty_el && vals.size() == ty_vec->lanes) {
+					for(auto val : vals) {
+						if(!fits(val, ty_el->width)) {
+							fail("lane literal does not fit the lanes", x);
+						}
+					}
+					r = std::make_shared<ir::constant_vec>(vals, ty_el->width);
 				}
 			}
 
@@ -0,0 +1,457 @@
+#ifndef ETCH_TRANSFORM_INFERENCE_HPP
+#define ETCH_TRANSFORM_INFERENCE_HPP 1
+
+#include <etch/transform/base.hpp>
+#include <unordered_map>
+
+namespace etch::transform {
+	// infers the types of every name and untyped literal from how they are
+	// defined, called and cast, then writes them back into the IR
+	//
+	// every node gets a term in a union-find store; unifying two terms links
+	// their roots, so each class is merged once and finds are near-constant
+	// with path halving. functions are monomorphic, and a variable is never
+	// linked to a term that contains it, so terms stay acyclic and
+	// self-application such as x <- x is an error
+	class inference : public base {
+		struct term {
+			enum class kind { var, literal, integer, vector, tuple, function, type, any };
+
+			kind k;
+			size_t width = 0;
+			size_t lanes = 0;
+			std::vector<size_t> args;
+		};
+
+		std::vector<term> terms;
+		std::vector<size_t> parent;
+		std::unordered_map<const ir::base *, size_t> of;
+
+		// lane intrinsics whose result is known once their vector's is
+		struct lane_op {
+			ir::ptr<ir::call> call;
+			size_t vec;
+			size_t el;
+			size_t result;
+		};
+		std::vector<lane_op> pending;
+
+		std::vector<ir::ptr<ir::identifier>> names;
+		std::vector<ir::ptr<ir::constant_int>> literals;
+
+		ir::ptr<ir::base> where;
+
+		size_t make(term t) {
+			terms.emplace_back(std::move(t));
+			parent.emplace_back(parent.size());
+			return parent.size() - 1;
+		}
+
+		size_t make(term::kind k, std::vector<size_t> args = {}, size_t width = 0, size_t lanes = 0) {
+			return make(term{k, width, lanes, std::move(args)});
+		}
+
+		size_t find(size_t x) {
+			while(parent[x] != x) {
+				parent[x] = parent[parent[x]];
+				x = parent[x];
+			}
+			return x;
+		}
+
+		size_t term_of(ir::ptr<ir::base> x) {
+			auto it = of.find(x.get());
+			if(it != of.end()) {
+				return it->second;
+			}
+			auto r = make(term::kind::var);
+			of.emplace(x.get(), r);
+			return r;
+		}
+
+		void set(ir::ptr<ir::base> x, size_t t) {
+			auto it = of.find(x.get());
+			if(it != of.end()) {
+				unify(it->second, t);
+			} else {
+				of.emplace(x.get(), t);
+			}
+		}
+
+		size_t from_type(ir::ptr<ir::base> ty) {
+			if(auto x = ir::as<ir::type_int>(ty)) {
+				return make(term::kind::integer, {}, x->width);
+			} else if(auto x = ir::as<ir::type_vec>(ty)) {
+				return make(term::kind::vector, {from_type(x->el)}, 0, x->lanes);
+			} else if(auto x = ir::as<ir::tuple>(ty)) {
+				std::vector<size_t> args;
+				for(auto &val : x->vals) {
+					args.emplace_back(from_type(val));
+				}
+				return make(term::kind::tuple, std::move(args));
+			} else if(auto x = ir::as<ir::function>(ty)) {
+				return make(term::kind::function, {from_type(x->arg), from_type(x->body)});
+			} else if(ir::is<ir::type_type>(ty)) {
+				return make(term::kind::type);
+			} else if(ir::is<ir::type_any>(ty)) {
+				return make(term::kind::any);
+			} else {
+				return make(term::kind::var);
+			}
+		}
+
+		// unresolved variables default to 32-bit integers, as literals do
+		ir::ptr<ir::base> to_type(size_t t) {
+			t = find(t);
+			auto &x = terms[t];
+			switch(x.k) {
+			case term::kind::var:
+				return std::make_shared<ir::type_int>(32);
+			case term::kind::literal:
+			case term::kind::integer:
+				return std::make_shared<ir::type_int>(x.width);
+			case term::kind::vector:
+				return std::make_shared<ir::type_vec>(to_type(x.args[0]), x.lanes);
+			case term::kind::tuple: {
+				auto r = std::make_shared<ir::tuple>();
+				for(auto arg : terms[t].args) {
+					r->push_back(to_type(arg));
+				}
+				return r;
+			}
+			case term::kind::function:
+				return std::make_shared<ir::function>(to_type(x.args[0]), to_type(x.args[1]));
+			case term::kind::type:
+				return std::make_shared<ir::type_type>();
+			case term::kind::any:
+				return std::make_shared<ir::type_any>();
+			}
+			return nullptr;
+		}
+
+		[[noreturn]] void fail(const std::string &what) {
+			std::ostringstream s;
+			s << "transform::inference: " << what;
+			if(where) {
+				s << " in:" << std::endl;
+				where->dump(s);
+			}
+			auto str = s.str();
+
+			std::cerr << str << std::endl << std::endl;
+			throw std::runtime_error(s.str());
+		}
+
+		[[noreturn]] void mismatch(size_t a, size_t b) {
+			std::ostringstream s;
+			s << "cannot unify ";
+			to_type(a)->dump_impl(s, 0);
+			s << " with ";
+			to_type(b)->dump_impl(s, 0);
+			fail(s.str());
+		}
+
+		// whether the root v is part of t
+		bool occurs(size_t v, size_t t) {
+			std::vector<size_t> work = {t};
+			while(!work.empty()) {
+				auto x = find(work.back());
+				work.pop_back();
+				if(x == v) {
+					return true;
+				}
+				work.insert(work.end(), terms[x].args.begin(), terms[x].args.end());
+			}
+			return false;
+		}
+
+		// links the variable x to y, unless y contains it
+		void link(size_t x, size_t y) {
+			if(!terms[y].args.empty() && occurs(x, y)) {
+				fail("a value's type would contain itself, as in a function applied to itself,");
+			}
+			parent[x] = y;
+		}
+
+		void unify(size_t a, size_t b) {
+			std::vector<std::pair<size_t, size_t>> work = {{a, b}};
+
+			while(!work.empty()) {
+				auto [x, y] = work.back();
+				work.pop_back();
+
+				x = find(x);
+				y = find(y);
+				if(x == y) {
+					continue;
+				}
+
+				auto kx = terms[x].k;
+				auto ky = terms[y].k;
+
+				if(kx == term::kind::any || ky == term::kind::any) {
+					continue;
+				}
+
+				// variables, then literals, give way to whatever is more specific
+				if(kx == term::kind::var) {
+					link(x, y);
+					continue;
+				}
+				if(ky == term::kind::var) {
+					link(y, x);
+					continue;
+				}
+				if(kx == term::kind::literal && (ky == term::kind::literal || ky == term::kind::integer)) {
+					parent[x] = y;
+					continue;
+				}
+				if(ky == term::kind::literal && kx == term::kind::integer) {
+					parent[y] = x;
+					continue;
+				}
+
+				auto &tx = terms[x];
+				auto &ty = terms[y];
+				if(kx != ky || tx.width != ty.width || tx.lanes != ty.lanes || tx.args.size() != ty.args.size()) {
+					mismatch(x, y);
+				}
+
+				// linked before their arguments are, so a class is only ever
+				// unified once
+				parent[x] = y;
+				for(size_t i = 0; i < tx.args.size(); ++i) {
+					work.emplace_back(tx.args[i], ty.args[i]);
+				}
+			}
+		}
+
+		// bindings are patterns of names, tuples and typed names
+		size_t pattern(ir::ptr<ir::base> x) {
+			if(auto id = ir::as<ir::identifier>(x)) {
+				names.emplace_back(id);
+				return term_of(id);
+			} else if(auto tuple = ir::as<ir::tuple>(x)) {
+				std::vector<size_t> args;
+				for(auto &val : tuple->vals) {
+					args.emplace_back(pattern(val));
+				}
+				auto r = make(term::kind::tuple, std::move(args));
+				set(tuple, r);
+				return r;
+			} else if(auto typed = ir::as<ir::cast>(x)) {
+				auto r = from_type(typed->ty);
+				unify(pattern(typed->val), r);
+				set(typed, r);
+				return r;
+			}
+			return term_of(x);
+		}
+
+		// lane operations whose vector type is known
+		bool lane(lane_op &op) {
+			auto v = find(op.vec);
+			if(terms[v].k != term::kind::vector) {
+				return false;
+			}
+
+			auto el = terms[v].args[0];
+			where = op.call;
+			if(ir::is<ir::intr_extract>(op.call->fn)) {
+				unify(op.result, el);
+			} else if(ir::is<ir::intr_insert>(op.call->fn)) {
+				unify(op.el, el);
+			} else if(ir::is<ir::intr_shuffle>(op.call->fn)) {
+				auto lanes = ir::intr_shuffle::mask(op.call->arg).size();
+				unify(op.result, make(term::kind::vector, {el}, 0, lanes));
+			}
+			return true;
+		}
+	  public:
+		ir::ptr<ir::base> visit(ir::ptr<ir::constant_int> x) override {
+			if(x->sized) {
+				set(x, make(term::kind::integer, {}, x->width));
+			} else {
+				set(x, make(term::kind::literal, {}, x->width));
+				literals.emplace_back(x);
+			}
+			return x;
+		}
+
+		ir::ptr<ir::base> visit(ir::ptr<ir::constant_vec> x) override {
+			set(x, from_type(x->type()));
+			return x;
+		}
+
+		ir::ptr<ir::base> visit(ir::ptr<ir::identifier> x) override {
+			if(binding) {
+				return x;
+			}
+
+			names.emplace_back(x);
+			if(auto find = lookup(x->str)) {
+				set(x, term_of(find));
+			} else if(!ir::is<ir::type_unresolved>(x->type())) {
+				set(x, from_type(x->type()));
+			}
+			return x;
+		}
+
+		ir::ptr<ir::base> visit(ir::ptr<ir::call> x) override {
+			where = x;
+
+			auto t = ir::as<ir::tuple>(x->arg);
+			auto arg = [&](size_t i) {
+				return term_of(t->vals[i]);
+			};
+
+			if(ir::is<ir::intr_add>(x->fn) || ir::is<ir::intr_mul>(x->fn)) {
+				// element-wise on vectors, so both sides and the result agree
+				if(t && t->vals.size() == 2) {
+					unify(arg(0), arg(1));
+					set(x, arg(0));
+				}
+			} else if(ir::is<ir::intr_extract>(x->fn) && t && t->vals.size() == 2) {
+				pending.push_back({x, arg(0), 0, term_of(x)});
+			} else if(ir::is<ir::intr_insert>(x->fn) && t && t->vals.size() == 3) {
+				set(x, arg(0));
+				pending.push_back({x, arg(0), arg(2), 0});
+			} else if(ir::is<ir::intr_shuffle>(x->fn) && t && t->vals.size() == 3) {
+				if(ir::intr_shuffle::mask(t).empty()) {
+					fail("shuffle mask is not a tuple of constant lanes");
+				}
+				unify(arg(0), arg(1));
+				pending.push_back({x, arg(0), 0, term_of(x)});
+			} else if(ir::is<ir::intr_int>(x->fn) || ir::is<ir::intr_vec>(x->fn)) {
+				set(x, make(term::kind::type));
+			} else if(!ir::is<ir::intr_generic>(x->fn)) {
+				auto r = term_of(x);
+				unify(term_of(x->fn), make(term::kind::function, {term_of(x->arg), r}));
+			}
+
+			return x;
+		}
+
+		ir::ptr<ir::base> visit(ir::ptr<ir::definition> x) override {
+			where = x;
+			unify(pattern(x->binding), term_of(x->val));
+			set(x, term_of(x->val));
+			return x;
+		}
+
+		ir::ptr<ir::base> visit(ir::ptr<ir::tuple> x) override {
+			if(binding) {
+				return x;
+			}
+
+			std::vector<size_t> args;
+			for(auto &val : x->vals) {
+				args.emplace_back(term_of(val));
+			}
+			set(x, make(term::kind::tuple, std::move(args)));
+			return x;
+		}
+
+		ir::ptr<ir::base> visit(ir::ptr<ir::block> x) override {
+			if(x->vals.empty()) {
+				set(x, make(term::kind::tuple));
+			} else {
+				set(x, term_of(x->vals.back()));
+			}
+			return x;
+		}
+
+		ir::ptr<ir::base> visit(ir::ptr<ir::function> x) override {
+			where = x;
+			set(x, make(term::kind::function, {pattern(x->arg), term_of(x->body)}));
+			return x;
+		}
+
+		ir::ptr<ir::base> visit(ir::ptr<ir::module_> x) override {
+			set(x, make(term::kind::type));
+			return x;
+		}
+
+		ir::ptr<ir::base> visit(ir::ptr<ir::cast> x) override {
+			if(binding) {
+				return x;
+			}
+
+			where = x;
+			auto r = from_type(x->ty);
+			set(x, r);
+
+			if(auto ty_vec = ir::as<ir::type_vec>(x->ty)) {
+				// vectors are built from a tuple of lanes or splat from one value
+				auto el = terms[find(r)].args[0];
+				if(auto tuple = ir::as<ir::tuple>(x->val)) {
+					for(auto &val : tuple->vals) {
+						unify(term_of(val), el);
+					}
+				} else {
+					unify(term_of(x->val), el);
+				}
+			} else {
+				unify(term_of(x->val), r);
+			}
+			return x;
+		}
+
+		ir::ptr<ir::base> visit(ir::ptr<ir::type_type> x) override {
+			set(x, make(term::kind::type));
+			return x;
+		}
+
+		ir::ptr<ir::base> visit(ir::ptr<ir::type_int> x) override {
+			set(x, make(term::kind::type));
+			return x;
+		}
+
+		ir::ptr<ir::base> visit(ir::ptr<ir::type_vec> x) override {
+			set(x, make(term::kind::type));
+			return x;
+		}
+
+		void run(ir::unit &au) {
+			base::run(au);
+
+			// lane operations may only learn their vector's type from later uses
+			for(auto progress = true; progress;) {
+				progress = false;
+				for(size_t i = 0; i < pending.size();) {
+					if(lane(pending[i])) {
+						pending[i] = pending.back();
+						pending.pop_back();
+						progress = true;
+					} else {
+						++i;
+					}
+				}
+			}
+
+			if(!pending.empty()) {
+				where = pending.front().call;
+				fail("cannot infer the vector type of a lane operation");
+			}
+
+			for(auto &x : literals) {
+				auto t = find(of.at(x.get()));
+				if(terms[t].k == term::kind::integer || terms[t].k == term::kind::literal) {
+					x->width = terms[t].width;
+				}
+			}
+
+			std::unordered_map<size_t, ir::ptr<ir::base>> types;
+			for(auto &x : names) {
+				auto t = find(term_of(x));
+				auto &ty = types[t];
+				if(!ty) {
+					ty = to_type(t);
+				}
+				x->resolve(ty);
+			}
+		}
+	};
+} // namespace etch::transform
+
+#endif
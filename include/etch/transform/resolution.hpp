@@ -9,6 +9,10 @@ namespace etch::transform {
 		ir::ptr<ir::base> visit(ir::ptr<ir::identifier> x) override {
 			ir::ptr<ir::base> r = x;
 
+			if(binding) {
+				return r;
+			}
+
 			if(auto find = lookup(x->str)) {
 				auto find_ty = find->type();
 				auto fty = ir::as<ir::function>(find->type());
@@ -0,0 +1,111 @@
+#include <etch/batch.hpp>
+#include <llvm/Support/ThreadPool.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <numeric>
+
+namespace etch {
+	void compile_batch(const std::vector<batch_input> &inputs, const compiler &proto, size_t threads, const std::function<void(batch_result)> &done, size_t max_inflight) {
+		std::vector<size_t> order(inputs.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&inputs](size_t a, size_t b) {
+			return inputs[a].source.size() > inputs[b].source.size();
+		});
+
+		std::mutex mtx;
+		std::condition_variable cv;
+		size_t inflight = 0;
+
+		// results are delivered under their own lock so that done need not be
+		// thread-safe
+		std::mutex done_mtx;
+
+		// the first exception done throws; no input is started after it and
+		// done is not called again
+		std::exception_ptr failure;
+
+		// gives a job's bytes back however it ends
+		struct release {
+			std::mutex &mtx;
+			std::condition_variable &cv;
+			size_t &inflight;
+			size_t size;
+
+			~release() {
+				{
+					std::lock_guard<std::mutex> lock(mtx);
+					inflight -= size;
+				}
+				cv.notify_all();
+			}
+		};
+
+		llvm::ThreadPool pool(llvm::hardware_concurrency((unsigned)threads));
+
+		for(auto i : order) {
+			auto size = inputs[i].source.size();
+
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				cv.wait(lock, [&] {
+					return inflight == 0 || inflight + size <= max_inflight;
+				});
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(done_mtx);
+				if(failure) {
+					break;
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				inflight += size;
+			}
+
+			pool.async([&, i, size] {
+				release r_inflight{mtx, cv, inflight, size};
+
+				// jobs record statistics and counters of their own, opened on
+				// the thread that runs the job and merged one job at a time
+				auto stats = proto.stats ? std::make_shared<statistics>() : nullptr;
+				auto perf = proto.perf ? std::make_shared<counters>() : nullptr;
+
+				batch_result r{i, {}, nullptr};
+				try {
+					compiler c = proto;
+					c.name = inputs[i].name;
+					c.stats = stats;
+					c.perf = perf;
+					r.output = c.run(inputs[i].source);
+				} catch(...) {
+					r.error = std::current_exception();
+				}
+
+				std::lock_guard<std::mutex> lock(done_mtx);
+				if(failure) {
+					return;
+				}
+				try {
+					if(stats) {
+						proto.stats->merge(*stats);
+					}
+					if(perf) {
+						proto.perf->merge(*perf);
+					}
+					done(std::move(r));
+				} catch(...) {
+					failure = std::current_exception();
+				}
+			});
+		}
+
+		pool.wait();
+
+		if(failure) {
+			std::rethrow_exception(failure);
+		}
+	}
+} // namespace etch
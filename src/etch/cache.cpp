@@ -0,0 +1,140 @@
+#include <etch/cache.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <tuple>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace etch {
+	namespace {
+		const std::string prefix = "etch-";
+		const std::string tmp_prefix = "tmp-";
+
+		// temporary files this old were left behind by a writer that died
+		const auto stale = std::chrono::hours(1);
+	} // namespace
+
+	cache::cache(std::string dir, uint64_t limit) : dir(dir), limit(limit) {
+		std::error_code ec;
+		fs::create_directories(dir, ec);
+		if(ec) {
+			std::cerr << "ERROR: cannot create cache directory: " << dir << std::endl;
+			throw std::runtime_error(ec.message());
+		}
+	}
+
+	std::optional<std::string> cache::get(const std::string &key) {
+		auto path = fs::path(dir) / (prefix + key);
+
+		std::ifstream f(path, std::ios::binary);
+		if(!f) {
+			return std::nullopt;
+		}
+
+		std::ostringstream s;
+		s << f.rdbuf();
+
+		// a hit makes the entry the most recently used one
+		std::error_code ec;
+		fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+		return s.str();
+	}
+
+	void cache::put(const std::string &key, std::string_view data) {
+		auto path = fs::path(dir) / (prefix + key);
+
+		std::random_device rd;
+		std::ostringstream tmp_name;
+		tmp_name << tmp_prefix << key << '-' << std::hex << rd() << rd();
+		auto tmp = fs::path(dir) / tmp_name.str();
+
+		{
+			// a short write may only show when the file is closed
+			std::ofstream f(tmp, std::ios::binary);
+			f.write(data.data(), (std::streamsize)data.size());
+			f.close();
+			if(!f) {
+				std::error_code ec;
+				fs::remove(tmp, ec);
+				return;
+			}
+		}
+
+		// the same key always holds the same bytes, so losing a race to
+		// another writer is harmless
+		std::error_code ec;
+		fs::rename(tmp, path, ec);
+		if(ec) {
+			fs::remove(tmp, ec);
+			return;
+		}
+
+		// the directory is only scanned again once this cache's own writes
+		// may have taken it over the limit
+		if(size) {
+			*size += data.size();
+		}
+		if(!size || *size > limit) {
+			prune();
+		}
+	}
+
+	void cache::prune() {
+		std::vector<std::tuple<fs::file_time_type, uint64_t, fs::path>> entries;
+		uint64_t total = 0;
+
+		auto now = fs::file_time_type::clock::now();
+
+		std::error_code ec;
+		for(auto &e : fs::directory_iterator(dir, ec)) {
+			auto name = e.path().filename().string();
+			if(name.compare(0, tmp_prefix.size(), tmp_prefix) == 0) {
+				auto time = e.last_write_time(ec);
+				if(!ec && now - time > stale) {
+					fs::remove(e.path(), ec);
+				}
+				continue;
+			}
+			if(name.compare(0, prefix.size(), prefix) != 0) {
+				continue;
+			}
+
+			auto size = e.file_size(ec);
+			if(ec) {
+				continue;
+			}
+			auto time = e.last_write_time(ec);
+			if(ec) {
+				continue;
+			}
+
+			entries.emplace_back(time, size, e.path());
+			total += size;
+		}
+
+		this->size = total;
+		if(total <= limit) {
+			return;
+		}
+
+		std::sort(entries.begin(), entries.end());
+
+		for(auto &[time, size, path] : entries) {
+			if(total <= limit) {
+				break;
+			}
+			// another process may have evicted it already
+			if(fs::remove(path, ec)) {
+				total -= size;
+			}
+		}
+		this->size = total;
+	}
+} // namespace etch
@@ -1,8 +1,82 @@
 #include <etch/codegen.hpp>
 #include <etch/mangling.hpp>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/TimeProfiler.h>
 #include <sstream>
 
 namespace etch {
+	namespace {
+		[[noreturn]] void fail(const char *what, ir::ptr<ir::base> val) {
+			std::ostringstream s;
+			s << "codegen: " << what << ": ";
+			val->dump(s);
+			auto str = s.str();
+
+			std::cerr << str << std::endl << std::endl;
+			throw std::runtime_error(str);
+		}
+
+		// the runtimes' entry points call main without arguments and exit with
+		// what it returns, see etch/rt.hpp
+		bool entry_point(ir::ptr<ir::base> ty) {
+			auto fn = ir::as<ir::function>(ty);
+			if(!fn) {
+				return false;
+			}
+			auto arg = ir::as<ir::tuple>(fn->arg);
+			auto ret = ir::as<ir::type_int>(fn->body);
+			return arg && arg->vals.empty() && ret && ret->width == 32;
+		}
+
+		// the argument of an intrinsic call, a tuple of n values
+		ir::ptr<ir::tuple> operands(ir::ptr<ir::call> call, size_t n) {
+			auto tuple = ir::as<ir::tuple>(call->arg);
+			if(!tuple || tuple->vals.size() != n) {
+				fail("wrong number of operands", call);
+			}
+			return tuple;
+		}
+
+		llvm::FixedVectorType * vector(llvm::Value *val, ir::ptr<ir::call> call) {
+			auto vty = llvm::dyn_cast<llvm::FixedVectorType>(val->getType());
+			if(!vty) {
+				fail("lane operation on a non-vector", call);
+			}
+			return vty;
+		}
+
+		// constant lanes must be in range, others are left to the hardware
+		void lane(llvm::Value *val, llvm::FixedVectorType *vty, ir::ptr<ir::call> call) {
+			if(!val->getType()->isIntegerTy()) {
+				fail("lane is not an integer", call);
+			}
+			if(auto c = llvm::dyn_cast<llvm::ConstantInt>(val); c && c->getValue().uge(vty->getNumElements())) {
+				fail("lane out of range", call);
+			}
+		}
+
+		// a profiler for a worker thread, handed over to the one that started
+		// the trace when the worker is done, even by an exception
+		class thread_trace {
+			bool enabled;
+		  public:
+			thread_trace(bool enabled, unsigned granularity) : enabled(enabled) {
+				if(enabled) {
+					llvm::timeTraceProfilerInitialize(granularity, "codegen");
+				}
+			}
+
+			~thread_trace() {
+				if(enabled) {
+					llvm::timeTraceProfilerFinishThread();
+				}
+			}
+		};
+	} // namespace
+
 	llvm::Type * codegen::type(ir::ptr<ir::base> ty) {
 		llvm::Type *r = nullptr;
 
@@ -20,20 +94,9 @@ namespace etch {
 				r = llvm::StructType::get(*ctx, lty_vals);
 			}
 		} else if(auto ty_fn = ir::as<ir::function>(ty)) {
-			std::vector<llvm::Type *> lty_args;
-
-			auto lty_arg = type(ty_fn->arg);
-			if(!lty_arg->isVoidTy()) {
-				lty_args.emplace_back(lty_arg);
-			}
-
-			auto lty_ret = type(ty_fn->body);
-
-			if(llvm::isa<llvm::FunctionType>(lty_ret)) {
-				lty_ret = lty_ret->getPointerTo();
-			}
-
-			r = llvm::FunctionType::get(lty_ret, lty_args, false);
+			r = lower(ty_fn).fty;
+		} else if(auto ty_vec = ir::as<ir::type_vec>(ty)) {
+			r = llvm::FixedVectorType::get(type(ty_vec->el), (unsigned)ty_vec->lanes);
 		} else {
 			std::ostringstream s;
 			s << "codegen: unhandled type: ";
@@ -58,19 +121,159 @@ namespace etch {
 				llvm::APInt ap((unsigned int)ty_int->width, val_int->val);
 				r = llvm::Constant::getIntegerValue(lty, ap);
 			}
+		} else if(auto val_vec = ir::as<ir::constant_vec>(val)) {
+			std::vector<llvm::Constant *> lanes;
+			for(auto &lane : val_vec->vals) {
+				lanes.emplace_back(llvm::ConstantInt::get(lty->getScalarType(), (uint64_t)(int64_t)lane, true));
+			}
+			r = llvm::ConstantVector::get(lanes);
 		}
 
 		return r;
 	}
 
-	void codegen::bind(std::shared_ptr<scope> scp, llvm::IRBuilder<> &builder, ir::ptr<ir::base> val, llvm::Value *lval) {
+	codegen::signature codegen::lower(ir::ptr<ir::function> ty_fn) {
+		signature sig;
+
+		sig.arg = type(ty_fn->arg);
+		sig.ret = type(ty_fn->body);
+
+		if(llvm::isa<llvm::FunctionType>(sig.ret)) {
+			sig.ret = sig.ret->getPointerTo();
+		}
+
+		std::vector<llvm::Type *> lty_args;
+		llvm::Type *lty_ret = sig.ret;
+
+		if(sig.ret->isVoidTy()) {
+			sig.ret_pass = signature::pass::none;
+		} else if(!sig.ret->isStructTy()) {
+			sig.ret_pass = signature::pass::direct;
+		} else {
+			std::vector<llvm::Type *> leaves;
+			flatten(sig.ret, leaves);
+
+			if(leaves.size() <= opts.abi_direct_ret) {
+				sig.ret_pass = signature::pass::flat;
+				lty_ret = llvm::StructType::get(*ctx, leaves);
+			} else {
+				sig.ret_pass = signature::pass::indirect;
+				lty_args.emplace_back(sig.ret->getPointerTo());
+				lty_ret = llvm::Type::getVoidTy(*ctx);
+			}
+		}
+
+		if(sig.arg->isVoidTy()) {
+			sig.arg_pass = signature::pass::none;
+		} else if(!sig.arg->isStructTy()) {
+			sig.arg_pass = signature::pass::direct;
+			lty_args.emplace_back(sig.arg);
+		} else {
+			std::vector<llvm::Type *> leaves;
+			flatten(sig.arg, leaves);
+
+			if(leaves.size() <= opts.abi_flat_args) {
+				sig.arg_pass = signature::pass::flat;
+				lty_args.insert(lty_args.end(), leaves.begin(), leaves.end());
+			} else {
+				sig.arg_pass = signature::pass::indirect;
+				lty_args.emplace_back(sig.arg->getPointerTo());
+			}
+		}
+
+		sig.fty = llvm::FunctionType::get(lty_ret, lty_args, false);
+
+		return sig;
+	}
+
+	template<typename T>
+	void codegen::annotate(const signature &sig, T *x) {
+		unsigned i = 0;
+
+		if(sig.ret_pass == signature::pass::indirect) {
+			auto &ctx = sig.ret->getContext();
+			x->addParamAttr(i, llvm::Attribute::getWithStructRetType(ctx, sig.ret));
+			x->addParamAttr(i, llvm::Attribute::NoAlias);
+			x->addParamAttr(i, llvm::Attribute::NoCapture);
+			++i;
+		}
+
+		if(sig.arg_pass == signature::pass::indirect) {
+			x->addParamAttr(i, llvm::Attribute::NoAlias);
+			x->addParamAttr(i, llvm::Attribute::NoCapture);
+			x->addParamAttr(i, llvm::Attribute::ReadOnly);
+		}
+	}
+
+	llvm::Function * codegen::prototype(const signature &sig, const std::string &name) {
+		auto f = llvm::Function::Create(sig.fty, llvm::Function::ExternalLinkage, name, *m);
+		annotate(sig, f);
+		return f;
+	}
+
+	llvm::Value * codegen::temporary(llvm::IRBuilder<> &builder, llvm::Type *lty) {
+		auto &bb_entry = builder.GetInsertBlock()->getParent()->getEntryBlock();
+		llvm::IRBuilder<> builder_entry(&bb_entry, bb_entry.begin());
+		return builder_entry.CreateAlloca(lty);
+	}
+
+	void codegen::flatten(llvm::Type *lty, std::vector<llvm::Type *> &leaves) {
+		if(auto sty = llvm::dyn_cast<llvm::StructType>(lty)) {
+			for(auto el : sty->elements()) {
+				flatten(el, leaves);
+			}
+		} else {
+			leaves.emplace_back(lty);
+		}
+	}
+
+	void codegen::flatten(llvm::IRBuilder<> &builder, llvm::Value *lval, std::vector<llvm::Value *> &leaves) {
+		if(auto sty = llvm::dyn_cast<llvm::StructType>(lval->getType())) {
+			for(unsigned i = 0; i < sty->getNumElements(); ++i) {
+				std::array<unsigned, 1> indices = {i};
+				flatten(builder, builder.CreateExtractValue(lval, indices), leaves);
+			}
+		} else {
+			leaves.emplace_back(lval);
+		}
+	}
+
+	llvm::Value * codegen::assemble(llvm::IRBuilder<> &builder, llvm::Type *lty, llvm::Value * const *&leaf) {
+		if(auto sty = llvm::dyn_cast<llvm::StructType>(lty)) {
+			llvm::Value *result = llvm::PoisonValue::get(sty);
+			for(unsigned i = 0; i < sty->getNumElements(); ++i) {
+				std::array<unsigned, 1> indices = {i};
+				result = builder.CreateInsertValue(result, assemble(builder, sty->getElementType(i), leaf), indices);
+			}
+			return result;
+		} else {
+			return *leaf++;
+		}
+	}
+
+	void codegen::bind(llvm::IRBuilder<> &builder, ir::ptr<ir::base> val, llvm::Type *lty, llvm::Value * const *&leaf) {
+		auto tuple = ir::as<ir::tuple>(val);
+		auto sty = llvm::dyn_cast<llvm::StructType>(lty);
+
+		if(tuple && sty && tuple->vals.size() == sty->getNumElements()) {
+			for(size_t i = 0; i < tuple->vals.size(); ++i) {
+				bind(builder, tuple->vals[i], sty->getElementType((unsigned)i), leaf);
+			}
+		} else {
+			bind(builder, val, assemble(builder, lty, leaf));
+		}
+	}
+
+	void codegen::bind(llvm::IRBuilder<> &builder, ir::ptr<ir::base> val, llvm::Value *lval) {
 		if(auto id = ir::as<ir::identifier>(val)) {
-			scp->push(id->str, lval);
+			syms.push(id->str, lval);
+		} else if(auto typed = ir::as<ir::cast>(val)) {
+			bind(builder, typed->val, lval);
 		} else if(auto tuple = ir::as<ir::tuple>(val)) {
 			for(size_t i = 0; i < tuple->vals.size(); ++i) {
 				std::array<unsigned, 1> indices = {(unsigned)i};
 				auto el = builder.CreateExtractValue(lval, indices);
-				bind(scp, builder, tuple->vals[i], el);
+				bind(builder, tuple->vals[i], el);
 			}
 		} else {
 			std::ostringstream s;
@@ -83,75 +286,314 @@ namespace etch {
 		}
 	}
 
-	llvm::Function * codegen::function(std::string name, ir::ptr<ir::function> fn) {
-		auto scp = std::make_shared<scope>(scope_module);
+	llvm::Function * codegen::function(const std::string &name, ir::ptr<ir::function> fn) {
+		auto base = syms.open();
 
-		auto ty = fn->type();
-		auto lty_fn = llvm::cast<llvm::FunctionType>(type(ty));
-		auto f = llvm::Function::Create(lty_fn, llvm::Function::ExternalLinkage, name, *m);
+		auto sig = lower(ir::as<ir::function>(fn->type()));
+		auto f = prototype(sig, name);
 
 		auto bb_entry = llvm::BasicBlock::Create(*ctx, "entry", f);
 		llvm::IRBuilder<> builder_entry(bb_entry);
 
-		if(lty_fn->getNumParams() == 1) {
-			bind(scp, builder_entry, fn->arg, f->getArg(0));
+		auto arg = f->arg_begin();
+
+		llvm::Value *sret = nullptr;
+		if(sig.ret_pass == signature::pass::indirect) {
+			sret = arg++;
 		}
 
-		if(auto ret = local(scp, builder_entry, fn->body)) {
+		if(sig.arg_pass == signature::pass::direct) {
+			bind(builder_entry, fn->arg, arg);
+		} else if(sig.arg_pass == signature::pass::flat) {
+			std::vector<llvm::Value *> leaves;
+			for(; arg != f->arg_end(); ++arg) {
+				leaves.emplace_back(arg);
+			}
+
+			llvm::Value * const *leaf = leaves.data();
+			bind(builder_entry, fn->arg, sig.arg, leaf);
+		} else if(sig.arg_pass == signature::pass::indirect) {
+			bind(builder_entry, fn->arg, builder_entry.CreateLoad(sig.arg, arg));
+		}
+
+		auto ret = local(base, builder_entry, fn->body);
+
+		if(sig.ret_pass == signature::pass::direct) {
+			builder_entry.CreateRet(ret);
+		} else if(sig.ret_pass == signature::pass::flat) {
+			auto lty_ret = sig.fty->getReturnType();
+			if(ret->getType() != lty_ret) {
+				std::vector<llvm::Value *> leaves;
+				flatten(builder_entry, ret, leaves);
+
+				llvm::Value * const *leaf = leaves.data();
+				ret = assemble(builder_entry, lty_ret, leaf);
+			}
 			builder_entry.CreateRet(ret);
+		} else if(sig.ret_pass == signature::pass::indirect) {
+			builder_entry.CreateStore(ret, sret);
+			builder_entry.CreateRetVoid();
 		} else {
 			builder_entry.CreateRetVoid();
 		}
 
+		syms.close(base);
+
 		return f;
 	}
 
-	llvm::Value * codegen::local(std::shared_ptr<scope> scp, llvm::IRBuilder<> &builder, ir::ptr<ir::base> val) {
+	// computed once per function, including those nested in others
+	const std::string & codegen::fingerprint(ir::ptr<ir::function> fn) {
+		auto it = keys.find(fn.get());
+		if(it == keys.end()) {
+			// functions do not capture, so they start from an empty set of locals
+			std::unordered_map<std::string_view, size_t> locals;
+			std::string key = "f";
+			if(!fingerprint(fn->arg, key, locals, true) || !fingerprint(fn->body, key, locals, false)) {
+				key.clear();
+			}
+			it = keys.emplace(fn.get(), std::move(key)).first;
+		}
+		return it->second;
+	}
+
+	// serializes everything codegen depends on; locally bound names are
+	// numbered so alpha-equivalent functions share a key, and free names are
+	// keyed by the symbol they currently resolve to
+	bool codegen::fingerprint(ir::ptr<ir::base> val, std::string &key, std::unordered_map<std::string_view, size_t> &locals, bool binding) {
+		if(val == nullptr) {
+			key += '0';
+			return true;
+		}
+
+		auto r = true;
+
+		if(auto x = ir::as<ir::constant_int>(val)) {
+			key += 'i' + std::to_string(x->val) + ':' + std::to_string(x->width);
+		} else if(auto x = ir::as<ir::constant_vec>(val)) {
+			key += 'v' + std::to_string(x->width) + ':' + std::to_string(x->vals.size());
+			for(auto &v : x->vals) {
+				key += ':' + std::to_string(v);
+			}
+		} else if(auto x = ir::as<ir::identifier>(val)) {
+			if(binding) {
+				auto idx = locals.size();
+				locals[x->str] = idx;
+			}
+
+			auto it = locals.find(x->str);
+			if(it != locals.end()) {
+				key += 'l' + std::to_string(it->second);
+			} else {
+				key += 'g' + std::to_string((uintptr_t)syms.find_global(x->str));
+			}
+
+			r = fingerprint(x->type(), key, locals, false);
+		} else if(auto x = ir::as<ir::call>(val)) {
+			key += 'c';
+			r = fingerprint(x->fn, key, locals, false) && fingerprint(x->arg, key, locals, false);
+		} else if(auto x = ir::as<ir::definition>(val)) {
+			key += 'd';
+			r = fingerprint(x->val, key, locals, false) && fingerprint(x->binding, key, locals, true);
+		} else if(auto x = ir::as<ir::tuple>(val)) {
+			key += 't' + std::to_string(x->vals.size());
+			for(auto &v : x->vals) {
+				r = r && fingerprint(v, key, locals, binding);
+			}
+		} else if(auto x = ir::as<ir::block>(val)) {
+			key += 'b' + std::to_string(x->vals.size());
+			for(auto &v : x->vals) {
+				r = r && fingerprint(v, key, locals, false);
+			}
+		} else if(auto x = ir::as<ir::function>(val)) {
+			auto &inner = fingerprint(x);
+			key += inner;
+			r = !inner.empty();
+		} else if(auto x = ir::as<ir::cast>(val)) {
+			key += 'x';
+			r = fingerprint(x->val, key, locals, binding) && fingerprint(x->ty, key, locals, false);
+		} else if(auto x = ir::as<ir::type_int>(val)) {
+			key += 'w' + std::to_string(x->width);
+		} else if(auto x = ir::as<ir::type_vec>(val)) {
+			key += 'V' + std::to_string(x->lanes);
+			r = fingerprint(x->el, key, locals, false);
+		} else if(ir::is<ir::type_type>(val)) {
+			key += 'T';
+		} else if(ir::is<ir::type_unresolved>(val)) {
+			key += 'U';
+		} else if(ir::is<ir::type_any>(val)) {
+			key += 'A';
+		} else if(ir::is<ir::intr_int>(val)) {
+			key += 'I';
+		} else if(ir::is<ir::intr_add>(val)) {
+			key += '+';
+		} else if(ir::is<ir::intr_mul>(val)) {
+			key += '*';
+		} else if(ir::is<ir::intr_vec>(val)) {
+			key += 'W';
+		} else if(ir::is<ir::intr_extract>(val)) {
+			key += 'E';
+		} else if(ir::is<ir::intr_insert>(val)) {
+			key += 'N';
+		} else if(ir::is<ir::intr_shuffle>(val)) {
+			key += 'S';
+		} else {
+			r = false;
+		}
+
+		if(!r) {
+			key.clear();
+		}
+
+		return r;
+	}
+
+	// the function generated earlier for a structurally identical one, or else
+	// the new one from generate; second is true for a new function
+	template<typename F>
+	std::pair<llvm::Function *, bool> codegen::merge(ir::ptr<ir::function> fn, F generate) {
+		if(!opts.merge_functions) {
+			return {generate(), true};
+		}
+
+		auto &key = fingerprint(fn);
+		if(key.empty()) {
+			return {generate(), true};
+		}
+
+		if(auto it = merged.find(key); it != merged.end()) {
+			return {it->second, false};
+		}
+
+		auto f = generate();
+		merged.emplace(key, f);
+		return {f, true};
+	}
+
+	llvm::Value * codegen::local(size_t base, llvm::IRBuilder<> &builder, ir::ptr<ir::base> val) {
 		llvm::Value *r = nullptr;
 
-		if(auto i = ir::as<ir::constant_int>(val)) {
-			r = constant(i);
+		if(ir::is<ir::constant_int>(val) || ir::is<ir::constant_vec>(val)) {
+			r = constant(val);
 		} else if(auto id = ir::as<ir::identifier>(val)) {
-			auto sym = scp->find(id->str);
-			if(llvm::isa<llvm::GlobalVariable>(sym) || llvm::isa<llvm::GlobalAlias>(sym)) {
-				auto lty = sym->getType()->getPointerElementType();
-				r = builder.CreateLoad(lty, sym);
+			auto sym = syms.find(id->str, base);
+			auto gv = llvm::dyn_cast<llvm::GlobalVariable>(sym);
+			if(auto alias = llvm::dyn_cast<llvm::GlobalAlias>(sym)) {
+				gv = llvm::dyn_cast<llvm::GlobalVariable>(alias->getAliasee()->stripPointerCasts());
+			}
+
+			if(gv && gv->isConstant() && gv->hasInitializer()) {
+				r = gv->getInitializer();
+			} else if(llvm::isa<llvm::GlobalVariable>(sym) || (llvm::isa<llvm::GlobalAlias>(sym) && gv)) {
+				r = builder.CreateLoad(sym->getType()->getPointerElementType(), sym);
 			} else {
 				r = sym;
 			}
 		} else if(auto call = ir::as<ir::call>(val)) {
-			if(ir::is<ir::intr_add>(call->fn)) {
-				auto tuple = ir::as<ir::tuple>(call->arg);
-				auto lhs = local(scp, builder, tuple->vals[0]);
-				auto rhs = local(scp, builder, tuple->vals[1]);
-				r = builder.CreateAdd(lhs, rhs);
-			} else if(ir::is<ir::intr_mul>(call->fn)) {
-				auto tuple = ir::as<ir::tuple>(call->arg);
-				auto lhs = local(scp, builder, tuple->vals[0]);
-				auto rhs = local(scp, builder, tuple->vals[1]);
-				r = builder.CreateMul(lhs, rhs);
-			} else {
-				auto fval = local(scp, builder, call->fn);
-				auto fvalty = fval->getType();
+			if(ir::is<ir::intr_add>(call->fn) || ir::is<ir::intr_mul>(call->fn)) {
+				auto tuple = operands(call, 2);
+				auto lhs = local(base, builder, tuple->vals[0]);
+				auto rhs = local(base, builder, tuple->vals[1]);
+				if(lhs->getType() != rhs->getType()) {
+					fail("operands of different types", call);
+				}
+				if(!lhs->getType()->isIntOrIntVectorTy()) {
+					fail("arithmetic on a non-integer", call);
+				}
+				r = ir::is<ir::intr_add>(call->fn) ? builder.CreateAdd(lhs, rhs) : builder.CreateMul(lhs, rhs);
+			} else if(ir::is<ir::intr_extract>(call->fn)) {
+				auto tuple = operands(call, 2);
+				auto vec = local(base, builder, tuple->vals[0]);
+				auto vty = vector(vec, call);
+				auto idx = local(base, builder, tuple->vals[1]);
+				lane(idx, vty, call);
+				r = builder.CreateExtractElement(vec, idx);
+			} else if(ir::is<ir::intr_insert>(call->fn)) {
+				auto tuple = operands(call, 3);
+				auto vec = local(base, builder, tuple->vals[0]);
+				auto vty = vector(vec, call);
+				auto idx = local(base, builder, tuple->vals[1]);
+				lane(idx, vty, call);
+				auto el = local(base, builder, tuple->vals[2]);
+				if(el->getType() != vty->getElementType()) {
+					fail("inserted value does not match the lanes", call);
+				}
+				r = builder.CreateInsertElement(vec, el, idx);
+			} else if(ir::is<ir::intr_shuffle>(call->fn)) {
+				auto tuple = operands(call, 3);
+				auto lhs = local(base, builder, tuple->vals[0]);
+				auto rhs = local(base, builder, tuple->vals[1]);
+				auto vty = vector(lhs, call);
+				if(lhs->getType() != rhs->getType()) {
+					fail("shuffle of vectors of different types", call);
+				}
 
-				if(fvalty->isPointerTy()) {
-					fvalty = fvalty->getPointerElementType();
+				auto mask = ir::intr_shuffle::mask(tuple);
+				if(mask.empty()) {
+					fail("shuffle mask is not constant", call);
+				}
+				for(auto m : mask) {
+					if(m < 0 || (size_t)m >= 2 * vty->getNumElements()) {
+						fail("shuffle lane out of range", call);
+					}
+				}
+				r = builder.CreateShuffleVector(lhs, rhs, mask);
+			} else {
+				auto ty_fn = ir::as<ir::function>(call->fn->type());
+				if(!ty_fn) {
+					std::ostringstream s;
+					s << "codegen: call to non-function: ";
+					call->dump(s);
+					auto str = s.str();
+
+					std::cerr << str << std::endl << std::endl;
+					throw std::runtime_error(s.str());
 				}
 
+				auto sig = lower(ty_fn);
+				auto fval = local(base, builder, call->fn);
+
 				std::vector<llvm::Value *> args;
-				if(auto v = local(scp, builder, call->arg)) {
+
+				llvm::Value *sret = nullptr;
+				if(sig.ret_pass == signature::pass::indirect) {
+					sret = temporary(builder, sig.ret);
+					args.emplace_back(sret);
+				}
+
+				auto v = local(base, builder, call->arg);
+
+				if(sig.arg_pass == signature::pass::direct) {
 					args.emplace_back(v);
+				} else if(sig.arg_pass == signature::pass::flat) {
+					flatten(builder, v, args);
+				} else if(sig.arg_pass == signature::pass::indirect) {
+					auto tmp = temporary(builder, sig.arg);
+					builder.CreateStore(v, tmp);
+					args.emplace_back(tmp);
 				}
 
-				auto fty = llvm::cast<llvm::FunctionType>(fvalty);
-				auto c = builder.CreateCall(fty, fval, args);
-				if(!fty->getReturnType()->isVoidTy()) {
+				auto c = builder.CreateCall(sig.fty, fval, args);
+				annotate(sig, c);
+
+				if(sig.ret_pass == signature::pass::direct) {
 					r = c;
+				} else if(sig.ret_pass == signature::pass::flat) {
+					r = c;
+					if(c->getType() != sig.ret) {
+						std::vector<llvm::Value *> leaves;
+						flatten(builder, c, leaves);
+
+						llvm::Value * const *leaf = leaves.data();
+						r = assemble(builder, sig.ret, leaf);
+					}
+				} else if(sig.ret_pass == signature::pass::indirect) {
+					r = builder.CreateLoad(sig.ret, sret);
 				}
 			}
 		} else if(auto def = ir::as<ir::definition>(val)) {
-			auto val = local(scp, builder, def->val);
-			bind(scp, builder, def->binding, val);
+			auto val = local(base, builder, def->val);
+			bind(builder, def->binding, val);
 
 			r = val;
 		} else if(auto tuple = ir::as<ir::tuple>(val)) {
@@ -160,7 +602,7 @@ namespace etch {
 				llvm::Value *result = llvm::PoisonValue::get(lty);
 
 				for(size_t i = 0; i < tuple->vals.size(); ++i) {
-					auto el = local(scp, builder, tuple->vals[i]);
+					auto el = local(base, builder, tuple->vals[i]);
 					std::array<unsigned, 1> indices = {(unsigned)i};
 					result = builder.CreateInsertValue(result, el, indices);
 				}
@@ -169,14 +611,46 @@ namespace etch {
 			}
 		} else if(auto block = ir::as<ir::block>(val)) {
 			for(auto &val : block->vals) {
-				r = local(scp, builder, val);
+				r = local(base, builder, val);
 			}
-		} else if(auto fn = ir::as<ir::function>(val)) {
-			stack.emplace_back("anon");
-			auto mangled = mangle(stack);
-			stack.pop_back();
+		} else if(auto typed = ir::as<ir::cast>(val); typed && ir::is<ir::type_vec>(typed->ty)) {
+			auto lty = llvm::cast<llvm::FixedVectorType>(type(typed->ty));
+
+			if(auto tuple = ir::as<ir::tuple>(typed->val)) {
+				if(tuple->vals.size() != lty->getNumElements()) {
+					fail("tuple does not match the vector's lanes", typed);
+				}
 
-			r = function(mangled, fn);
+				llvm::Value *result = llvm::PoisonValue::get(lty);
+				for(size_t i = 0; i < tuple->vals.size(); ++i) {
+					auto el = local(base, builder, tuple->vals[i]);
+					if(el->getType() != lty->getElementType()) {
+						fail("tuple does not match the vector's lanes", typed);
+					}
+					result = builder.CreateInsertElement(result, el, (uint64_t)i);
+				}
+				r = result;
+			} else {
+				auto el = local(base, builder, typed->val);
+				if(el->getType() == lty) {
+					r = el;
+				} else if(el->getType() == lty->getElementType()) {
+					r = builder.CreateVectorSplat(lty->getNumElements(), el);
+				} else {
+					fail("splat does not match the vector's lanes", typed);
+				}
+			}
+		} else if(auto typed = ir::as<ir::cast>(val)) {
+			// inference has given the value this type already
+			r = local(base, builder, typed->val);
+		} else if(auto fn = ir::as<ir::function>(val)) {
+			r = merge(fn, [&] {
+				// functions nested in it are named below it
+				scope = scope->anonymous();
+				auto f = function(scope->str(), fn);
+				scope = scope->up();
+				return f;
+			}).first;
 		} else {
 			std::ostringstream s;
 			s << "codegen: unhandled value: ";
@@ -190,26 +664,119 @@ namespace etch {
 		return r;
 	}
 
+	llvm::Constant * codegen::declaration(ir::ptr<ir::base> val) {
+		llvm::Constant *r = nullptr;
+
+		auto &mangled = scope->str();
+
+		// constants keep their value for local() to use; the definition from
+		// another part replaces them when the parts are linked
+		if(ir::is<ir::constant_int>(val) || ir::is<ir::constant_vec>(val)) {
+			auto c = constant(val);
+			r = new llvm::GlobalVariable(*m, c->getType(), true, llvm::GlobalValue::AvailableExternallyLinkage, c, mangled);
+		} else if(auto id = ir::as<ir::identifier>(val)) {
+			auto gv = llvm::cast<llvm::GlobalValue>(syms.find_global(id->str));
+			auto var = llvm::dyn_cast<llvm::GlobalVariable>(gv);
+			if(auto f = llvm::dyn_cast<llvm::Function>(gv)) {
+				auto decl = llvm::Function::Create(f->getFunctionType(), llvm::Function::ExternalLinkage, mangled, *m);
+				decl->setAttributes(f->getAttributes());
+				r = decl;
+			} else if(var && var->isConstant() && var->hasInitializer()) {
+				r = new llvm::GlobalVariable(*m, var->getValueType(), true, llvm::GlobalValue::AvailableExternallyLinkage, var->getInitializer(), mangled);
+			} else {
+				r = new llvm::GlobalVariable(*m, gv->getValueType(), true, llvm::GlobalValue::ExternalLinkage, nullptr, mangled);
+			}
+		} else if(auto def = ir::as<ir::definition>(val)) {
+			r = declaration(def->val);
+		} else if(auto fn = ir::as<ir::function>(val)) {
+			auto sig = lower(ir::as<ir::function>(fn->type()));
+			auto [f, created] = merge(fn, [&] {
+				auto f = prototype(sig, mangled);
+				reserve(fn->body);
+				return f;
+			});
+			r = created ? f : prototype(sig, mangled);
+		} else if(auto m = ir::as<ir::module_>(val)) {
+			run(m);
+		} else {
+			r = global(val);
+		}
+
+		return r;
+	}
+
+	// declares the functions generating val would add, under the same names
+	// and in the same order as local(), for later functions to merge with
+	void codegen::reserve(ir::ptr<ir::base> val) {
+		if(!opts.merge_functions) {
+			return;
+		}
+
+		if(auto call = ir::as<ir::call>(val)) {
+			reserve(call->fn);
+			reserve(call->arg);
+		} else if(auto def = ir::as<ir::definition>(val)) {
+			reserve(def->val);
+		} else if(auto tuple = ir::as<ir::tuple>(val)) {
+			for(auto &val : tuple->vals) {
+				reserve(val);
+			}
+		} else if(auto block = ir::as<ir::block>(val)) {
+			for(auto &val : block->vals) {
+				reserve(val);
+			}
+		} else if(auto typed = ir::as<ir::cast>(val)) {
+			reserve(typed->val);
+		} else if(auto fn = ir::as<ir::function>(val)) {
+			merge(fn, [&] {
+				scope = scope->anonymous();
+				auto f = prototype(lower(ir::as<ir::function>(fn->type())), scope->str());
+				reserve(fn->body);
+				scope = scope->up();
+				return f;
+			});
+		}
+	}
+
+	// the global that a top-level definition of val becomes an alias of
+	llvm::GlobalValue * codegen::aliasee(ir::ptr<ir::base> val) {
+		if(auto id = ir::as<ir::identifier>(val)) {
+			return llvm::cast_or_null<llvm::GlobalValue>(syms.find_global(id->str));
+		}
+
+		if(auto fn = ir::as<ir::function>(val); fn && opts.merge_functions) {
+			auto &key = fingerprint(fn);
+			if(auto it = merged.find(key); !key.empty() && it != merged.end()) {
+				return it->second;
+			}
+		}
+
+		return nullptr;
+	}
+
 	llvm::Constant * codegen::global(ir::ptr<ir::base> val) {
 		llvm::Constant *r = nullptr;
 
 		auto ty = val->type();
 
-		auto mangled = mangle(stack);
+		auto &mangled = scope->str();
 
-		if(auto i = ir::as<ir::constant_int>(val)) {
-			auto c = constant(i);
+		if(ir::is<ir::constant_int>(val) || ir::is<ir::constant_vec>(val)) {
+			auto c = constant(val);
 			r = new llvm::GlobalVariable(*m, c->getType(), true, llvm::GlobalValue::ExternalLinkage, c, mangled);
 		} else if(auto id = ir::as<ir::identifier>(val)) {
-			auto gv = llvm::cast<llvm::GlobalValue>(scope_module->find(id->str));
+			auto gv = llvm::cast<llvm::GlobalValue>(syms.find_global(id->str));
 			r = llvm::GlobalAlias::create(mangled, gv);
 		} else if(auto def = ir::as<ir::definition>(val)) {
 			r = global(def->val);
 		} else if(auto fn = ir::as<ir::function>(val)) {
-			r = function(mangled, fn);
+			auto [f, created] = merge(fn, [&] {
+				return function(mangled, fn);
+			});
+			r = created ? (llvm::Constant *)f : llvm::GlobalAlias::create(mangled, f);
 		} else if(auto m = ir::as<ir::module_>(val)) {
 			run(m);
-		} else if(ir::is<ir::type_int>(val)) {
+		} else if(ir::is<ir::type_int>(val) || ir::is<ir::type_vec>(val)) {
 		} else {
 			std::ostringstream s;
 			s << "codegen: unhandled global: ";
@@ -227,14 +794,32 @@ namespace etch {
 		for(auto &val : am->defs) {
 			if(auto def = ir::as<ir::definition>(val)) {
 				auto id = ir::as<ir::identifier>(def->binding);
-				std::string scope_name = id ? id->str : "anon";
+				std::string_view scope_name = id ? std::string_view(id->str) : "anon";
+
+				if(scope->root()) {
+					// unnamed definitions cannot be referenced, keep them in one part
+					declare = id ? index++ % parts != part : part != 0;
+
+					if(id && id->str == "main" && !entry_point(def->val->type())) {
+						fail("main must be () -> i32", def);
+					}
+				}
+
+				// aliases, including merged functions, are defined in whichever
+				// part defines their target
+				auto decl = declare;
+				if(auto gv = aliasee(def->val)) {
+					decl = gv->isDeclarationForLinker();
+				}
+
+				llvm::TimeTraceScope trace(decl ? "declare" : "define", scope_name);
 
-				stack.emplace_back(scope_name);
+				scope = id ? scope->child(scope_name) : scope->anonymous();
 
-				auto r = global(def);
+				auto r = decl ? declaration(def) : global(def);
 
-				stack.pop_back();
-				scope_module->push(scope_name, r);
+				scope = scope->up();
+				syms.push_global(scope_name, r);
 			}
 		}
 	}
@@ -243,5 +828,79 @@ namespace etch {
 		for(auto &am : au.modules) {
 			run(am);
 		}
+
+		if(parts == 1) {
+			finalize(*m, opts);
+		}
+	}
+
+	void codegen::finalize(llvm::Module &m, const options &opts) {
+		if(!opts.internalize) {
+			return;
+		}
+
+		for(auto &gv : m.global_values()) {
+			if(!gv.isDeclaration() && !opts.exports.count(gv.getName().str())) {
+				gv.setLinkage(llvm::GlobalValue::InternalLinkage);
+			}
+		}
+
+		for(auto &f : m) {
+			if(f.hasLocalLinkage() && !f.hasAddressTaken()) {
+				f.setCallingConv(llvm::CallingConv::Fast);
+				for(auto user : f.users()) {
+					llvm::cast<llvm::CallBase>(user)->setCallingConv(llvm::CallingConv::Fast);
+				}
+			}
+		}
+	}
+
+	void codegen::run(llvm::Module &dst, const ir::unit &au, size_t threads, const options &opts, unsigned trace_granularity) {
+		llvm::ThreadPool pool(llvm::hardware_concurrency((unsigned)threads));
+
+		// workers trace into profilers of their own, merged when written
+		auto trace = llvm::timeTraceProfilerEnabled();
+
+		std::vector<std::shared_future<std::string>> parts;
+		for(size_t i = 0; i < threads; ++i) {
+			parts.emplace_back(pool.async([&au, &opts, threads, i, trace, trace_granularity] {
+				thread_trace t(trace, trace_granularity);
+
+				std::string bc;
+				{
+					llvm::TimeTraceScope scope("codegen part", std::to_string(i));
+
+					auto ctx = std::make_shared<llvm::LLVMContext>();
+					auto m = std::make_shared<llvm::Module>("part", *ctx);
+
+					codegen cg{ctx, m, threads, i};
+					cg.opts = opts;
+					cg.run(au);
+
+					llvm::raw_string_ostream os(bc);
+					llvm::WriteBitcodeToFile(*m, os);
+					os.flush();
+				}
+
+				return bc;
+			}));
+		}
+
+		for(auto &part : parts) {
+			auto &bc = part.get();
+
+			llvm::TimeTraceScope scope("link part");
+
+			auto pm = llvm::parseBitcodeFile(llvm::MemoryBufferRef(bc, "part"), dst.getContext());
+			if(!pm) {
+				throw std::runtime_error("codegen: cannot read part: " + llvm::toString(pm.takeError()));
+			}
+
+			if(llvm::Linker::linkModules(dst, std::move(*pm))) {
+				throw std::runtime_error("codegen: cannot link part");
+			}
+		}
+
+		finalize(dst, opts);
 	}
 } // namespace etch
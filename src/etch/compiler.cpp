@@ -2,89 +2,554 @@
 #include <etch/codegen.hpp>
 #include <etch/compiler.hpp>
 #include <etch/parser.hpp>
+#include <etch/session.hpp>
 #include <etch/transform/fold.hpp>
+#include <etch/transform/inference.hpp>
 #include <etch/transform/resolution.hpp>
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Analysis/ModuleSummaryAnalysis.h>
+#include <llvm/Analysis/ProfileSummaryInfo.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
 #include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/Passes/PassBuilder.h>
 #include <llvm/Support/Host.h>
-#include <llvm/Support/TargetRegistry.h>
-#include <llvm/Support/TargetSelect.h>
-#include <llvm/Target/TargetOptions.h>
+#include <llvm/Support/SmallVectorMemoryBuffer.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/TimeProfiler.h>
 #include <llvm/Target/TargetMachine.h>
+#include <algorithm>
+#include <mutex>
+#include <sstream>
 
 namespace etch {
-	std::string compiler::run(std::string_view sv) {
-		auto sm = parse(sv);
-		auto am = analysis::semantics{}.run(sm);
+	namespace {
+		// appends straight to a string, so that output is not staged in a
+		// second buffer
+		class string_ostream : public llvm::raw_pwrite_stream {
+			std::string &str;
+
+			void write_impl(const char *ptr, size_t size) override {
+				str.append(ptr, size);
+			}
+
+			void pwrite_impl(const char *ptr, size_t size, uint64_t offset) override {
+				str.replace(offset, size, ptr, size);
+			}
+
+			uint64_t current_pos() const override {
+				return str.size();
+			}
+		  public:
+			string_ostream(std::string &str) : str(str) {
+				SetUnbuffered();
+			}
+		};
+
+		// profiles one compile on the calling thread unless something else is
+		// profiling it already
+		// LLVM collects the profilers of finished threads in one global list,
+		// which every write and cleanup takes all of, so traced compiles run
+		// one at a time
+		std::mutex trace_mtx;
+
+		class trace {
+			const std::string &path;
+			bool owned = false;
+			std::unique_lock<std::mutex> lock;
+		  public:
+			trace(const std::string &path, unsigned granularity, const std::string &name) : path(path) {
+				if(!path.empty() && !llvm::timeTraceProfilerEnabled()) {
+					lock = std::unique_lock<std::mutex>(trace_mtx);
+					llvm::timeTraceProfilerInitialize(granularity, name);
+					owned = true;
+				}
+			}
+
+			~trace() {
+				if(owned) {
+					if(auto err = llvm::timeTraceProfilerWrite(path, "")) {
+						std::cerr << "ERROR: cannot write time trace: " << llvm::toString(std::move(err)) << std::endl;
+					}
+					llvm::timeTraceProfilerCleanup();
+				}
+			}
+		};
+
+		// one compiler phase, seen by the time profiler and the hardware
+		// counters
+		class phase {
+			llvm::TimeTraceScope scope;
+			counters *perf;
+		  public:
+			phase(const char *name, counters *perf) : scope(name), perf(perf) {
+				if(perf) {
+					perf->begin(name);
+				}
+			}
+
+			~phase() {
+				if(perf) {
+					perf->end();
+				}
+			}
+		};
+	} // namespace
+
+	void compiler::optimize(llvm::TargetMachine &tm) {
+		llvm::OptimizationLevel level;
+		switch(opt) {
+		case opt_level::O0: level = llvm::OptimizationLevel::O0; break;
+		case opt_level::O1: level = llvm::OptimizationLevel::O1; break;
+		case opt_level::O2: level = llvm::OptimizationLevel::O2; break;
+		case opt_level::O3: level = llvm::OptimizationLevel::O3; break;
+		case opt_level::Os: level = llvm::OptimizationLevel::Os; break;
+		case opt_level::Oz: level = llvm::OptimizationLevel::Oz; break;
+		}
+
+		llvm::LoopAnalysisManager lam;
+		llvm::FunctionAnalysisManager fam;
+		llvm::CGSCCAnalysisManager cgam;
+		llvm::ModuleAnalysisManager mam;
+
+		llvm::Optional<llvm::PGOOptions> pgo_opts;
+		switch(pgo) {
+		case pgo_mode::instrument: pgo_opts = llvm::PGOOptions(profile, "", "", llvm::PGOOptions::IRInstr); break;
+		case pgo_mode::use: pgo_opts = llvm::PGOOptions(profile, "", "", llvm::PGOOptions::IRUse); break;
+		default: break;
+		}
+
+		// one trace event and counter sample per pass run
+		llvm::PassInstrumentationCallbacks pic;
+		auto trace = llvm::timeTraceProfilerEnabled();
+		auto c = perf.get();
+		if(trace || c) {
+			auto end = [trace, c] {
+				if(trace) {
+					llvm::timeTraceProfilerEnd();
+				}
+				if(c) {
+					c->end();
+				}
+			};
+			pic.registerBeforeNonSkippedPassCallback([trace, c](llvm::StringRef pass, llvm::Any) {
+				if(trace) {
+					llvm::timeTraceProfilerBegin(pass, "");
+				}
+				if(c) {
+					c->begin(pass.str());
+				}
+			});
+			pic.registerAfterPassCallback([end](llvm::StringRef, llvm::Any, const llvm::PreservedAnalyses &) {
+				end();
+			});
+			pic.registerAfterPassInvalidatedCallback([end](llvm::StringRef, const llvm::PreservedAnalyses &) {
+				end();
+			});
+		}
+
+		// the target machine provides TargetIRAnalysis and its alias analyses
+		llvm::PassBuilder pb(&tm, llvm::PipelineTuningOptions(), pgo_opts, &pic);
+
+		fam.registerPass([&] { return pb.buildDefaultAAPipeline(); });
+		pb.registerModuleAnalyses(mam);
+		pb.registerCGSCCAnalyses(cgam);
+		pb.registerFunctionAnalyses(fam);
+		pb.registerLoopAnalyses(lam);
+		pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+		// bitcode is optimized again at link time, so only the pre-link
+		// pipelines run here
+		llvm::ModulePassManager mpm;
+		if(level == llvm::OptimizationLevel::O0) {
+			mpm = pb.buildO0DefaultPipeline(level, tgt == target::bitcode);
+		} else if(tgt != target::bitcode) {
+			mpm = pb.buildPerModuleDefaultPipeline(level);
+		} else if(lto == lto_mode::thin) {
+			mpm = pb.buildThinLTOPreLinkDefaultPipeline(level);
+		} else {
+			mpm = pb.buildLTOPreLinkDefaultPipeline(level);
+		}
+		phase scope("optimize", perf.get());
+		mpm.run(*m, mam);
+	}
+
+	void compiler::generate(std::string_view sv, const codegen::options &opts) {
+		// every compile starts from an empty module
+		m.reset();
+		ctx = std::make_shared<llvm::LLVMContext>();
+		m = std::make_shared<llvm::Module>(name, *ctx);
+
+		syntax::unit sm;
+		{
+			phase scope("parse", perf.get());
+			sm = parse(sv);
+		}
+
+		if(stats) {
+			stats->record("parse");
+		}
+
+		ir::unit am;
+		{
+			phase scope("semantics", perf.get());
+			am = analysis::semantics{}.run(sm);
+		}
+
+		if(stats) {
+			statistics::count(stats->record("semantics"), am);
+		}
 
 		if(debug) {
 			std::cout << "=== semantic analysis ===" << std::endl;
 			am.dump() << std::endl;
 		}
 
-		transform::resolution{}.run(am);
+		{
+			phase scope("resolution", perf.get());
+			transform::resolution t;
+			t.run(am);
+
+			if(stats) {
+				auto &p = stats->record("resolution");
+				statistics::count(p, am);
+				p.visited = t.visited;
+				p.rewritten = t.rewritten;
+			}
+		}
 
 		if(debug) {
 			std::cout << "=== type resolution ===" << std::endl;
 			am.dump() << std::endl;
 		}
 
-		transform::fold{}.run(am);
+		{
+			phase scope("fold", perf.get());
+			transform::fold t;
+			t.run(am);
+
+			if(stats) {
+				auto &p = stats->record("fold");
+				statistics::count(p, am);
+				p.visited = t.visited;
+				p.rewritten = t.rewritten;
+			}
+		}
 
 		if(debug) {
 			std::cout << "=== constant folding ===" << std::endl;
 			am.dump() << std::endl;
 		}
 
-		codegen{ctx, m}.run(am);
+		{
+			phase scope("inference", perf.get());
+			transform::inference t;
+			t.run(am);
 
-		llvm::verifyModule(*m, &llvm::errs());
+			if(stats) {
+				auto &p = stats->record("inference");
+				statistics::count(p, am);
+				p.visited = t.visited;
+				p.rewritten = t.rewritten;
+			}
+		}
 
-		// output LLVM assembly to string
+		if(debug) {
+			std::cout << "=== type inference ===" << std::endl;
+			am.dump() << std::endl;
+		}
 
-		if(tgt == target::llvm_assembly) {
-			std::string ll;
-			llvm::raw_string_ostream os(ll);
-			os << *m;
-			os.flush();
+		phase scope("codegen", perf.get());
+		if(threads > 1) {
+			codegen::run(*m, am, threads, opts, time_trace_granularity);
+		} else {
+			codegen cg{ctx, m};
+			cg.opts = opts;
+			cg.run(am);
+		}
+
+		if(stats) {
+			statistics::count(stats->record("codegen"), *m);
+		}
+	}
 
-			return ll;
+	void compiler::run(std::string_view sv, jit &engine) {
+		if(pgo == pgo_mode::instrument) {
+			std::cerr << "ERROR: instrumented code cannot run on the JIT, which has no profile runtime" << std::endl;
+			throw std::runtime_error("instrumented code cannot run on the JIT");
 		}
 
-		// emit object
+		// definitions stay visible so that they can be looked up by name
+		auto opts = cg_opts;
+		opts.internalize = false;
+
+		trace t(time_trace, time_trace_granularity, name);
 
-		llvm::InitializeAllTargetInfos();
-		llvm::InitializeAllTargets();
-		llvm::InitializeAllTargetMCs();
-		llvm::InitializeAllAsmPrinters();
-		llvm::InitializeAllAsmParsers();
+		generate(sv, opts);
 
 		auto triple = llvm::sys::getDefaultTargetTriple();
+		auto [tm_cpu, tm_features] = machine();
+		auto target_machine = [&] {
+			phase scope("target machine", perf.get());
+			return (sess ? *sess : session::shared()).acquire(triple, tm_cpu, tm_features, cg_level());
+		}();
+
 		m->setTargetTriple(triple);
+		m->setDataLayout(target_machine->createDataLayout());
 
-		//std::cout << "target triple = " << triple << std::endl;
+		verify();
+
+		optimize(*target_machine);
+
+		if(stats) {
+			statistics::count(stats->record("optimize"), *m);
+		}
+
+		engine.add(*m);
+	}
+
+	void compiler::verify() {
+		phase scope("verify", perf.get());
 
 		std::string err;
-		auto target = llvm::TargetRegistry::lookupTarget(triple, err);
+		llvm::raw_string_ostream os(err);
+		if(llvm::verifyModule(*m, &os)) {
+			std::ostringstream s;
+			s << "codegen produced invalid IR:" << std::endl << os.str();
+			auto str = s.str();
 
-		std::string cpu = "generic";
-		std::string features = "";
-		llvm::TargetOptions opts;
-		auto target_machine = target->createTargetMachine(triple, cpu, features, opts, {});
+			std::cerr << str << std::endl << std::endl;
+			throw std::runtime_error("codegen produced invalid IR");
+		}
+	}
+
+	llvm::CodeGenOpt::Level compiler::cg_level() const {
+		switch(opt) {
+		case opt_level::O0: return llvm::CodeGenOpt::None;
+		case opt_level::O1: return llvm::CodeGenOpt::Less;
+		case opt_level::O3: return llvm::CodeGenOpt::Aggressive;
+		default: return llvm::CodeGenOpt::Default;
+		}
+	}
 
+	std::pair<std::string, std::string> compiler::machine() const {
+		if(cpu != "native") {
+			return {cpu, features};
+		}
+
+		// the host's own features, as with clang's -march=native, so that
+		// those the cpu name implies but the OS or hypervisor turned off (such
+		// as AVX-512 without its XSAVE state) stay off; sorted to keep the
+		// string and with it the cache key stable, explicit features on top
+		llvm::SubtargetFeatures sf;
+		llvm::StringMap<bool> host_features;
+		if(llvm::sys::getHostCPUFeatures(host_features)) {
+			std::vector<llvm::StringRef> names;
+			for(auto &f : host_features) {
+				names.emplace_back(f.first());
+			}
+			std::sort(names.begin(), names.end());
+			for(auto &name : names) {
+				sf.AddFeature(name, host_features.lookup(name));
+			}
+		}
+		for(auto &f : llvm::SubtargetFeatures(features).getFeatures()) {
+			sf.AddFeature(f);
+		}
+
+		return {llvm::sys::getHostCPUName().str(), sf.getString()};
+	}
+
+	std::string compiler::key(std::string_view sv) const {
+		llvm::SHA1 h;
+
+		// length-prefixed so that adjacent fields cannot run into each other
+		auto add = [&h](std::string_view str) {
+			auto size = (uint64_t)str.size();
+			h.update(llvm::ArrayRef<uint8_t>((const uint8_t *)&size, sizeof(size)));
+			h.update(llvm::StringRef(str.data(), str.size()));
+		};
+
+		add(ETCH_VERSION);
+		add(LLVM_VERSION_STRING);
+		add(sv);
+		// the module and source file name end up in the output
+		add(name);
+		add(std::to_string((int)tgt));
+		add(llvm::sys::getDefaultTargetTriple());
+
+		auto [tm_cpu, tm_features] = machine();
+		add(tm_cpu);
+		add(tm_features);
+
+		add(std::to_string((int)opt));
+		// parallel codegen splits definitions into parts that are linked back
+		// in a different order
+		add(std::to_string(threads));
+		add(std::to_string((int)lto));
+		add(std::to_string((int)pgo));
+		if(pgo == pgo_mode::use) {
+			// the profile's contents matter, not its path
+			auto buf = llvm::MemoryBuffer::getFile(profile);
+			add(buf ? (*buf)->getBuffer().str() : profile);
+		} else {
+			add(profile);
+		}
+
+		add(std::to_string(sections));
+
+		add(std::to_string(cg_opts.abi_flat_args));
+		add(std::to_string(cg_opts.abi_direct_ret));
+		add(std::to_string(cg_opts.merge_functions));
+		add(std::to_string(cg_opts.internalize));
+		std::vector<std::string> exports(cg_opts.exports.begin(), cg_opts.exports.end());
+		std::sort(exports.begin(), exports.end());
+		for(auto &e : exports) {
+			add(e);
+		}
+
+		add("multiversion");
+		for(auto &fn : mv) {
+			add(fn);
+		}
+		for(auto &level : mv.levels) {
+			add(level);
+		}
+		add(mv.baseline);
+
+		return llvm::toHex(h.final(), true);
+	}
+
+	std::string compiler::run(std::string_view sv) {
+		std::string r;
+
+		auto k = objects ? key(sv) : std::string();
+		if(objects) {
+			if(auto hit = objects->get(k)) {
+				return *hit;
+			}
+		}
+
+		string_ostream os(r);
+		emit(sv, os);
+
+		if(objects) {
+			objects->put(k, r);
+		}
+		return r;
+	}
+
+	void compiler::run(std::string_view sv, llvm::raw_pwrite_stream &os) {
+		// a cache entry is a string anyway
+		if(objects) {
+			os << run(sv);
+			return;
+		}
+
+		emit(sv, os);
+	}
+
+	void compiler::run(std::string_view sv, int fd) {
+		llvm::raw_fd_ostream fd_os(fd, false);
+
+		// object writers seek back to patch headers, which pipes cannot do
+		if(fd_os.supportsSeeking()) {
+			run(sv, fd_os);
+		} else {
+			llvm::buffer_ostream b_os(fd_os);
+			run(sv, b_os);
+		}
+	}
+
+	void compiler::run(std::string_view sv, llvm::SmallVectorImpl<char> &buf) {
+		llvm::raw_svector_ostream os(buf);
+		run(sv, os);
+	}
+
+	std::unique_ptr<llvm::MemoryBuffer> compiler::run_buffer(std::string_view sv) {
+		llvm::SmallVector<char, 0> buf;
+		run(sv, buf);
+		return std::make_unique<llvm::SmallVectorMemoryBuffer>(std::move(buf), name);
+	}
+
+	void compiler::emit(std::string_view sv, llvm::raw_pwrite_stream &os) {
+		trace t(time_trace, time_trace_granularity, name);
+
+		// bitcode is linked with other modules that may call anything in it,
+		// so it is only internalized down to exports that were given
+		auto opts = cg_opts;
+		if(tgt == target::bitcode && opts.exports == codegen::options{}.exports) {
+			opts.internalize = false;
+		}
+
+		generate(sv, opts);
+
+		// target machine
+
+		auto triple = llvm::sys::getDefaultTargetTriple();
+
+		//std::cout << "target triple = " << triple << std::endl;
+
+		auto [tm_cpu, tm_features] = machine();
+
+		auto target_machine = [&] {
+			phase scope("target machine", perf.get());
+			return (sess ? *sess : session::shared()).acquire(triple, tm_cpu, tm_features, cg_level());
+		}();
+
+		// pooled target machines are shared between compiles
+		target_machine->Options.FunctionSections = sections;
+		target_machine->Options.DataSections = sections;
+		target_machine->Options.EmitAddrsig = sections;
+
+		m->setTargetTriple(triple);
 		m->setDataLayout(target_machine->createDataLayout());
 
-		llvm::SmallString<256> output;
-		llvm::raw_svector_ostream s_output(output);
+		{
+			phase scope("multiversion", perf.get());
+			mv.run(*m, llvm::Triple(triple));
+		}
 
-		llvm::legacy::PassManager pm;
+		verify();
 
-		auto ft = tgt == target::binary ? llvm::CGFT_ObjectFile : llvm::CGFT_AssemblyFile;
+		optimize(*target_machine);
 
-		if(target_machine->addPassesToEmitFile(pm, s_output, nullptr, ft)) {
-			std::cerr << "ERROR: cannot emit file type" << std::endl;
+		if(stats) {
+			statistics::count(stats->record("optimize"), *m);
 		}
-		pm.run(*m);
 
-		return std::string(output);
+		// output LLVM assembly
+
+		phase scope("emit", perf.get());
+
+		if(tgt == target::llvm_assembly) {
+			// output LLVM assembly
+			os << *m;
+		} else if(tgt == target::bitcode) {
+			// output LLVM bitcode
+			if(lto == lto_mode::thin) {
+				llvm::ProfileSummaryInfo psi(*m);
+				auto index = llvm::buildModuleSummaryIndex(*m, nullptr, &psi);
+				llvm::WriteBitcodeToFile(*m, os, false, &index, true);
+			} else {
+				llvm::WriteBitcodeToFile(*m, os);
+			}
+		} else {
+			// emit object
+			llvm::legacy::PassManager pm;
+
+			auto ft = tgt == target::binary ? llvm::CGFT_ObjectFile : llvm::CGFT_AssemblyFile;
+
+			if(target_machine->addPassesToEmitFile(pm, os, nullptr, ft)) {
+				std::cerr << "ERROR: cannot emit file type" << std::endl;
+			}
+			pm.run(*m);
+		}
+		os.flush();
+
+		if(stats) {
+			stats->record("emit");
+		}
 	}
 } // namespace etch
@@ -0,0 +1,143 @@
+#include <etch/counters.hpp>
+#include <iomanip>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace etch {
+#if defined(__linux__)
+	namespace {
+		const uint64_t configs[counters::num_events] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES
+		};
+	} // namespace
+
+	counters::counters() : owner(std::this_thread::get_id()) {
+		fds.fill(-1);
+
+		for(size_t i = 0; i < num_events; ++i) {
+			perf_event_attr attr{};
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[i];
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			// threads started later add their counts when they exit; the
+			// kernel does not allow that for groups, so events stand alone
+			attr.inherit = 1;
+			// with more events than the PMU has counters the kernel takes
+			// turns, so each one is scaled by the share it was counted for
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+			// events the machine or the permissions do not allow are left out
+			fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+	}
+
+	counters::~counters() {
+		for(auto fd : fds) {
+			if(fd >= 0) {
+				close(fd);
+			}
+		}
+	}
+
+	counters::reading counters::read() const {
+		reading r{clock::now(), {}};
+
+		for(size_t i = 0; i < num_events; ++i) {
+			count c;
+			if(fds[i] >= 0 && ::read(fds[i], &c, sizeof(c)) == (ssize_t)sizeof(c)) {
+				r.counts[i] = c;
+			}
+		}
+		return r;
+	}
+#else
+	counters::counters() : owner(std::this_thread::get_id()) {
+		fds.fill(-1);
+	}
+
+	counters::~counters() {}
+
+	counters::reading counters::read() const {
+		return {clock::now(), {}};
+	}
+#endif
+
+	void counters::check() const {
+		if(std::this_thread::get_id() != owner) {
+			std::cerr << "ERROR: counters: used on a thread other than the one that opened them" << std::endl;
+			throw std::runtime_error("counters: used on a thread other than the one that opened them");
+		}
+	}
+
+	void counters::begin(std::string name) {
+		check();
+		auto now = read();
+
+		std::lock_guard<std::mutex> lock(mtx);
+		samples.push_back({std::move(name), open.size(), 0, {}});
+		open.emplace_back(samples.size() - 1, now);
+	}
+
+	void counters::end() {
+		check();
+		auto now = read();
+
+		std::lock_guard<std::mutex> lock(mtx);
+		auto &[index, start] = open.back();
+
+		auto &sm = samples[index];
+		sm.seconds = std::chrono::duration<double>(now.time - start.time).count();
+		for(size_t i = 0; i < num_events; ++i) {
+			auto value = now.counts[i].value - start.counts[i].value;
+			auto enabled = now.counts[i].enabled - start.counts[i].enabled;
+			auto running = now.counts[i].running - start.counts[i].running;
+			sm.values[i] = running ? (uint64_t)((double)value * (double)enabled / (double)running) : 0;
+		}
+
+		open.pop_back();
+	}
+
+	void counters::merge(const counters &o) {
+		std::scoped_lock lock(mtx, o.mtx);
+		samples.insert(samples.end(), o.samples.begin(), o.samples.end());
+	}
+
+	std::ostream & counters::dump(std::ostream &s) const {
+		const char *names[num_events] = {"cycles", "instructions", "cache-misses", "branch-misses"};
+
+		std::lock_guard<std::mutex> lock(mtx);
+
+		s << std::left << std::setw(40) << "phase" << std::right << std::setw(12) << "ms";
+		for(size_t i = 0; i < num_events; ++i) {
+			s << std::setw(15) << names[i];
+		}
+		s << std::setw(8) << "IPC" << std::endl;
+
+		// samples are in the order they began, nested ones indented
+		for(auto &sm : samples) {
+			s << std::left << std::setw(40) << (std::string(sm.depth * 2, ' ') + sm.name);
+			s << std::right << std::setw(12) << std::fixed << std::setprecision(3) << sm.seconds * 1000;
+			for(size_t i = 0; i < num_events; ++i) {
+				if(available((event)i)) {
+					s << std::setw(15) << sm.values[i];
+				} else {
+					s << std::setw(15) << "n/a";
+				}
+			}
+			if(available(cycles) && available(instructions) && sm.values[cycles]) {
+				s << std::setw(8) << std::setprecision(2) << (double)sm.values[instructions] / (double)sm.values[cycles];
+			}
+			s << std::endl;
+		}
+		return s;
+	}
+} // namespace etch
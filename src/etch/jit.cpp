@@ -0,0 +1,75 @@
+#include <etch/jit.hpp>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/Support/TargetSelect.h>
+#include <iostream>
+
+namespace etch {
+	jit::jit(size_t threads, llvm::CodeGenOpt::Level level) {
+		llvm::InitializeNativeTarget();
+		llvm::InitializeNativeTargetAsmPrinter();
+
+		auto jtmb = llvm::orc::JITTargetMachineBuilder::detectHost();
+		if(!jtmb) {
+			auto str = llvm::toString(jtmb.takeError());
+			std::cerr << "ERROR: cannot detect host: " << str << std::endl;
+			throw std::runtime_error(str);
+		}
+		jtmb->setCodeGenOptLevel(level);
+
+		auto j = llvm::orc::LLLazyJITBuilder()
+			.setJITTargetMachineBuilder(std::move(*jtmb))
+			.setNumCompileThreads((unsigned)threads)
+			.create();
+		if(!j) {
+			auto str = llvm::toString(j.takeError());
+			std::cerr << "ERROR: cannot create JIT: " << str << std::endl;
+			throw std::runtime_error(str);
+		}
+		lljit = std::move(*j);
+
+		lljit->setPartitionFunction(llvm::orc::CompileOnDemandLayer::compileRequested);
+
+		// host symbols, e.g. the runtime, resolve against the process
+		auto gen = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(lljit->getDataLayout().getGlobalPrefix());
+		if(gen) {
+			lljit->getMainJITDylib().addGenerator(std::move(*gen));
+		} else {
+			llvm::consumeError(gen.takeError());
+		}
+	}
+
+	void jit::add(const llvm::Module &src) {
+		// the module moves into a context owned by the JIT
+		std::string bc;
+		llvm::raw_string_ostream os(bc);
+		llvm::WriteBitcodeToFile(src, os);
+		os.flush();
+
+		auto ctx = std::make_unique<llvm::LLVMContext>();
+		auto m = llvm::parseBitcodeFile(llvm::MemoryBufferRef(bc, src.getModuleIdentifier()), *ctx);
+		if(!m) {
+			throw std::runtime_error("jit: cannot read module: " + llvm::toString(m.takeError()));
+		}
+
+		(*m)->setDataLayout(lljit->getDataLayout());
+		(*m)->setTargetTriple(lljit->getTargetTriple().str());
+
+		llvm::orc::ThreadSafeModule tsm(std::move(*m), std::move(ctx));
+		if(auto err = lljit->addLazyIRModule(std::move(tsm))) {
+			throw std::runtime_error("jit: cannot add module: " + llvm::toString(std::move(err)));
+		}
+	}
+
+	uint64_t jit::address(const std::string &name) {
+		auto sym = lljit->lookup(name);
+		if(!sym) {
+			auto str = llvm::toString(sym.takeError());
+			std::cerr << "ERROR: cannot find symbol: " << name << std::endl;
+			throw std::runtime_error(str);
+		}
+		return sym->getAddress();
+	}
+} // namespace etch
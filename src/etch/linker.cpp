@@ -1,26 +1,348 @@
 #include <etch/linker.hpp>
 #include <etch/mangling.hpp>
 #include <lld/Common/Driver.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SmallVectorMemoryBuffer.h>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 namespace etch {
-	void linker::run(std::string output) {
+	namespace {
+		[[noreturn]] void fail(const std::string &str) {
+			std::cerr << "ERROR: " << str << std::endl;
+			throw std::runtime_error(str);
+		}
+
+#if defined(__linux__)
+		// sizes of the sections in lld's --print-gc-sections and
+		// --print-icf-sections listing, e.g. "removing unused section a.o:(.text.f)";
+		// anything else is passed through
+		linker::report tally(llvm::StringRef listing, const std::unordered_map<std::string, llvm::MemoryBufferRef> &buffers) {
+			linker::report r;
+
+			std::unordered_map<std::string, llvm::StringMap<size_t>> objects;
+			auto size = [&](llvm::StringRef file, llvm::StringRef section) -> size_t {
+				auto it = objects.find(file.str());
+				if(it == objects.end()) {
+					it = objects.emplace(file.str(), llvm::StringMap<size_t>()).first;
+
+					std::unique_ptr<llvm::MemoryBuffer> owned;
+					llvm::MemoryBufferRef ref;
+					if(auto b = buffers.find(file.str()); b != buffers.end()) {
+						ref = b->second;
+					} else if(auto f = llvm::MemoryBuffer::getFile(file)) {
+						owned = std::move(*f);
+						ref = owned->getMemBufferRef();
+					} else {
+						// archive members, LTO output
+						return 0;
+					}
+
+					auto obj = llvm::object::ObjectFile::createObjectFile(ref);
+					if(!obj) {
+						llvm::consumeError(obj.takeError());
+						return 0;
+					}
+					for(auto &sec : (*obj)->sections()) {
+						if(auto name = sec.getName()) {
+							it->second.try_emplace(*name, sec.getSize());
+						} else {
+							llvm::consumeError(name.takeError());
+						}
+					}
+				}
+
+				auto sec = it->second.find(section);
+				return sec != it->second.end() ? sec->second : 0;
+			};
+
+			llvm::SmallVector<llvm::StringRef, 0> lines;
+			listing.split(lines, '\n', -1, false);
+			for(auto line : lines) {
+				auto l = line.trim();
+
+				size_t *count, *bytes;
+				if(l.consume_front("removing unused section ")) {
+					count = &r.gc_sections;
+					bytes = &r.gc_bytes;
+				} else if(l.consume_front("removing identical section ")) {
+					count = &r.icf_sections;
+					bytes = &r.icf_bytes;
+				} else if(l.startswith("selected section ")) {
+					continue;
+				} else {
+					llvm::outs() << line << '\n';
+					continue;
+				}
+
+				auto [file, section] = l.rsplit(":(");
+				section.consume_back(")");
+
+				++*count;
+				*bytes += size(file, section);
+			}
+
+			return r;
+		}
+
+		// closes the descriptor when it leaves scope
+		struct fd {
+			int n = -1;
+
+			fd(int n) : n(n) {}
+			fd(fd &&o) : n(o.n) {
+				o.n = -1;
+			}
+			~fd() {
+				if(n >= 0) {
+					::close(n);
+				}
+			}
+
+			std::string path() const {
+				return "/proc/self/fd/" + std::to_string(n);
+			}
+		};
+
+		// lld opens inputs by path, so buffers are copied into anonymous
+		// in-memory files that have one
+		fd memory_file(const llvm::MemoryBuffer &buf) {
+			fd f(::memfd_create(buf.getBufferIdentifier().str().c_str(), MFD_CLOEXEC));
+			if(f.n < 0) {
+				fail("cannot create memory file for " + buf.getBufferIdentifier().str());
+			}
+
+			auto data = buf.getBufferStart();
+			auto size = buf.getBufferSize();
+			while(size) {
+				auto n = ::write(f.n, data, size);
+				if(n < 0) {
+					fail("cannot write memory file for " + buf.getBufferIdentifier().str());
+				}
+				data += n;
+				size -= (size_t)n;
+			}
+			return f;
+		}
+#endif
+	} // namespace
+
+	void linker::link(const std::string &output) {
 		std::vector<const char *> args;
 #if defined(_WIN32)
+		if(!buffers.empty()) {
+			fail("linker: in-memory inputs are not supported on this platform");
+		}
+
+		if(profile) {
+			fail("linker: the profile runtime is not supported on this platform");
+		}
+
 		args.emplace_back("lld-link.exe");
 		for(auto &input : inputs) {
 			args.emplace_back(input.data());
 		}
 		args.emplace_back("/subsystem:CONSOLE");
 
+		args.emplace_back(gc_sections ? "/opt:ref" : "/opt:noref");
+		args.emplace_back(icf ? "/opt:icf" : "/opt:noicf");
+
 		std::string str_entry("/entry:" + mangle({"etch", "rt", "entry"}));
 		args.emplace_back(str_entry.data());
 
 		std::string str_out("/out:" + output);
 		args.emplace_back(str_out.data());
 
-		lld::coff::link(args, false, llvm::outs(), llvm::errs());
+		std::string str_lto_opt("/opt:lldlto=" + std::to_string(lto_opt));
+		args.emplace_back(str_lto_opt.data());
+
+		std::string str_lto_jobs("/opt:lldltojobs=" + std::to_string(lto_jobs));
+		if(lto_jobs) {
+			args.emplace_back(str_lto_jobs.data());
+		}
+
+		std::string str_lto_cache("/lldltocache:" + lto_cache);
+		if(!lto_cache.empty()) {
+			args.emplace_back(str_lto_cache.data());
+		}
+
+		std::string str_threads("/threads:" + std::to_string(threads));
+		if(threads) {
+			args.emplace_back(str_threads.data());
+		}
+
+		if(!lld::coff::link(args, llvm::outs(), llvm::errs(), false, false)) {
+			fail("linker: cannot link");
+		}
+#elif defined(__linux__)
+		args.emplace_back("ld.lld");
+
+		for(auto &input : inputs) {
+			args.emplace_back(input.data());
+		}
+
+		std::vector<fd> files;
+		std::vector<std::string> paths;
+		files.reserve(buffers.size());
+		paths.reserve(buffers.size());
+		for(auto &buf : buffers) {
+			files.emplace_back(memory_file(*buf));
+			paths.emplace_back(files.back().path());
+			args.emplace_back(paths.back().data());
+		}
+
+		// the runtime archives, from where etch was built unless told
+		std::string rt_dir = runtime_dir;
+#if defined(ETCH_RT_DIR)
+		if(rt_dir.empty()) {
+			rt_dir = ETCH_RT_DIR;
+		}
+#endif
+
+		// only pulled in for the symbols the inputs leave undefined, so entry
+		// points defined in etch code take precedence; without the bundled
+		// runtime, libc's start files enter the executable and call main,
+		// which the libc flavour supplies unless the inputs define it
+		llvm::SmallString<256> rt_path(rt_dir);
+		llvm::sys::path::append(rt_path, runtime ? "libetch-rt.a" : "libetch-rt-libc.a");
+		bool bundled = runtime && !rt_dir.empty();
+		if(!rt_dir.empty()) {
+			args.emplace_back(rt_path.c_str());
+		}
+		if(bundled) {
+			args.emplace_back("-static");
+		}
+
+		// the bundled runtime exits straight through the kernel, so the
+		// profile runtime's atexit handler would never run
+		if(profile) {
+			if(runtime) {
+				fail("linker: the profile runtime needs libc, not the bundled runtime");
+			}
+#if defined(ETCH_PROFILE_RT_PATH)
+			args.emplace_back(ETCH_PROFILE_RT_PATH);
+			args.emplace_back("-u__llvm_profile_runtime");
+#else
+			fail("linker: no profile runtime was found when etch was built");
+#endif
+		}
+
+		std::string str_entry(mangle({"etch", "rt", "entry"}));
+		if(bundled) {
+			args.emplace_back("-e");
+			args.emplace_back(str_entry.data());
+		}
+
+		args.emplace_back("-o");
+		args.emplace_back(output.data());
+
+		std::string str_lto_opt("--lto-O" + std::to_string(lto_opt));
+		args.emplace_back(str_lto_opt.data());
+
+		std::string str_lto_jobs("--thinlto-jobs=" + std::to_string(lto_jobs));
+		if(lto_jobs) {
+			args.emplace_back(str_lto_jobs.data());
+		}
+
+		std::string str_lto_cache("--thinlto-cache-dir=" + lto_cache);
+		if(!lto_cache.empty()) {
+			args.emplace_back(str_lto_cache.data());
+		}
+
+		std::string str_threads("--threads=" + std::to_string(threads));
+		if(threads) {
+			args.emplace_back(str_threads.data());
+		}
+
+		if(gc_sections) {
+			args.emplace_back("--gc-sections");
+			if(removed) {
+				args.emplace_back("--print-gc-sections");
+			}
+		}
+		if(icf) {
+			args.emplace_back("--icf=safe");
+			if(removed) {
+				args.emplace_back("--print-icf-sections");
+			}
+		}
+
+		std::string listing;
+		llvm::raw_string_ostream os(listing);
+		auto ok = lld::elf::link(args, removed ? (llvm::raw_ostream &)os : llvm::outs(), llvm::errs(), false, false);
+
+		if(removed) {
+			os.flush();
+
+			std::unordered_map<std::string, llvm::MemoryBufferRef> refs;
+			for(size_t i = 0; i < buffers.size(); ++i) {
+				refs.emplace(paths[i], buffers[i]->getMemBufferRef());
+			}
+			*removed = tally(listing, refs);
+		}
+
+		if(!ok) {
+			fail("linker: cannot link");
+		}
 #else
 #error Linking is not supported on this platform
+#endif
+	}
+
+	std::ostream & linker::report::dump(std::ostream &s) const {
+		s << "gc-sections: " << gc_sections << " sections, " << gc_bytes << " B removed" << std::endl;
+		s << "icf: " << icf_sections << " sections, " << icf_bytes << " B folded" << std::endl;
+		return s;
+	}
+
+	void linker::run(std::string output) {
+		link(output);
+	}
+
+	std::unique_ptr<llvm::MemoryBuffer> linker::run_buffer() {
+#if defined(__linux__)
+		// lld buffers outputs that are not regular files in memory and writes
+		// them out in one go at the end, here into a pipe drained meanwhile
+		int p[2];
+		if(::pipe2(p, O_CLOEXEC)) {
+			fail("linker: cannot create pipe");
+		}
+		fd in(p[0]);
+		auto out = std::make_unique<fd>(p[1]);
+
+		llvm::SmallVector<char, 0> buf;
+		std::thread reader([&] {
+			char chunk[65536];
+			ssize_t n;
+			while((n = ::read(in.n, chunk, sizeof(chunk))) > 0) {
+				buf.append(chunk, chunk + n);
+			}
+		});
+
+		// the reader sees the end once lld's descriptor and ours are closed
+		try {
+			link(out->path());
+		} catch(...) {
+			out.reset();
+			reader.join();
+			throw;
+		}
+		out.reset();
+		reader.join();
+
+		return std::make_unique<llvm::SmallVectorMemoryBuffer>(std::move(buf), "a.out");
+#else
+		fail("linker: linking in memory is not supported on this platform");
 #endif
 	}
 } // namespace etch
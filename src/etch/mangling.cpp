@@ -1,14 +1,72 @@
 #include <etch/mangling.hpp>
-#include <sstream>
 
 namespace etch {
-	std::string mangle(std::vector<std::string> names) {
-		std::ostringstream s;
-		s << "etch.1";
+	namespace {
+		const std::string_view prefix = "etch.1";
+	} // namespace
+
+	std::string mangle(const std::vector<std::string> &names) {
+		size_t size = prefix.size();
 		for(auto &name : names) {
-			s << '.' << name;
+			size += name.size() + 1;
 		}
-		return s.str();
+
+		std::string r;
+		r.reserve(size);
+		r += prefix;
+		for(auto &name : names) {
+			r += '.';
+			r += name;
+		}
+		return r;
+	}
+
+	std::optional<std::vector<std::string>> demangle(std::string_view sv) {
+		if(sv.substr(0, prefix.size()) != prefix) {
+			return std::nullopt;
+		}
+		sv.remove_prefix(prefix.size());
+
+		std::vector<std::string> r;
+		while(!sv.empty()) {
+			if(sv[0] != '.') {
+				return std::nullopt;
+			}
+			sv.remove_prefix(1);
+
+			auto n = sv.find('.');
+			if(!n || sv.empty()) {
+				return std::nullopt;
+			}
+			r.emplace_back(sv.substr(0, n));
+			sv.remove_prefix(n == std::string_view::npos ? sv.size() : n);
+		}
+		return r;
+	}
+
+	symbol::symbol() : mangled(prefix) {}
+
+	symbol::symbol(symbol *parent, std::string_view name) : parent(parent) {
+		mangled.reserve(parent->mangled.size() + 1 + name.size());
+		mangled += parent->mangled;
+		mangled += '.';
+		mangled += name;
+		this->name = std::string_view(mangled).substr(parent->mangled.size() + 1);
+	}
+
+	symbol * symbol::child(std::string_view name) {
+		auto it = children.find(name);
+		if(it != children.end()) {
+			return it->second.get();
+		}
+
+		std::unique_ptr<symbol> c(new symbol(this, name));
+		auto r = c.get();
+		children.emplace(r->name, std::move(c));
+		return r;
 	}
-} // namespace etch
 
+	symbol * symbol::anonymous() {
+		return child(std::to_string(anonymous_count++));
+	}
+} // namespace etch
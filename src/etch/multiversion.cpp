@@ -0,0 +1,163 @@
+#include <etch/multiversion.hpp>
+#include <llvm/IR/GlobalIFunc.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InlineAsm.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <iostream>
+#include <sstream>
+
+namespace etch {
+	namespace {
+		enum reg { leaf1_ecx, leaf7_ebx, ext1_ecx, xcr0, num_regs };
+
+		struct level {
+			const char *name;
+			uint32_t masks[num_regs];
+		};
+
+		// x86-64 psABI micro-architecture levels
+		constexpr uint32_t v2_leaf1_ecx = (1u << 0) | (1u << 9) | (1u << 13) | (1u << 19) | (1u << 20) | (1u << 23);
+		constexpr uint32_t v3_leaf1_ecx = v2_leaf1_ecx | (1u << 12) | (1u << 22) | (1u << 27) | (1u << 28) | (1u << 29);
+		constexpr uint32_t v3_leaf7_ebx = (1u << 3) | (1u << 5) | (1u << 8);
+		constexpr uint32_t v4_leaf7_ebx = v3_leaf7_ebx | (1u << 16) | (1u << 17) | (1u << 28) | (1u << 30) | (1u << 31);
+
+		const level levels_x86_64[] = {
+			{"x86-64-v2", {v2_leaf1_ecx, 0,            1u << 0,               0}},
+			{"x86-64-v3", {v3_leaf1_ecx, v3_leaf7_ebx, (1u << 0) | (1u << 5), 0x06}},
+			{"x86-64-v4", {v3_leaf1_ecx, v4_leaf7_ebx, (1u << 0) | (1u << 5), 0xe6}},
+		};
+
+		const level * find_level(const std::string &name) {
+			for(auto &l : levels_x86_64) {
+				if(name == l.name) {
+					return &l;
+				}
+			}
+
+			std::ostringstream s;
+			s << "multiversion: unknown ISA level: " << name;
+			auto str = s.str();
+
+			std::cerr << str << std::endl << std::endl;
+			throw std::runtime_error(s.str());
+		}
+
+		llvm::Value * cpuid(llvm::IRBuilder<> &builder, uint32_t leaf, unsigned idx) {
+			auto i32 = builder.getInt32Ty();
+			auto ty_ret = llvm::StructType::get(i32, i32, i32, i32);
+			auto ty_fn = llvm::FunctionType::get(ty_ret, {i32, i32}, false);
+			auto fn = llvm::InlineAsm::get(ty_fn, "cpuid", "={ax},={bx},={cx},={dx},{ax},{cx},~{dirflag},~{fpsr},~{flags}", false);
+
+			std::array<unsigned, 1> indices = {idx};
+			auto regs = builder.CreateCall(ty_fn, fn, {builder.getInt32(leaf), builder.getInt32(0)});
+			return builder.CreateExtractValue(regs, indices);
+		}
+
+		// reads the feature registers once; a leaf the cpu does not report and
+		// xcr0 without osxsave read as zero
+		std::array<llvm::Value *, num_regs> features(llvm::IRBuilder<> &builder) {
+			std::array<llvm::Value *, num_regs> r;
+
+			auto zero = builder.getInt32(0);
+
+			auto max = cpuid(builder, 0, 0);
+			auto max_ext = cpuid(builder, 0x80000000, 0);
+
+			r[leaf1_ecx] = cpuid(builder, 1, 2);
+			r[leaf7_ebx] = builder.CreateSelect(builder.CreateICmpUGE(max, builder.getInt32(7)), cpuid(builder, 7, 1), zero);
+			r[ext1_ecx] = builder.CreateSelect(builder.CreateICmpUGE(max_ext, builder.getInt32(0x80000001)), cpuid(builder, 0x80000001, 2), zero);
+
+			auto f = builder.GetInsertBlock()->getParent();
+			auto &ctx = f->getContext();
+
+			auto bb_entry = builder.GetInsertBlock();
+			auto bb_xgetbv = llvm::BasicBlock::Create(ctx, "xgetbv", f);
+			auto bb_done = llvm::BasicBlock::Create(ctx, "done", f);
+
+			auto osxsave = builder.CreateAnd(r[leaf1_ecx], builder.getInt32(1u << 27));
+			builder.CreateCondBr(builder.CreateICmpNE(osxsave, zero), bb_xgetbv, bb_done);
+
+			builder.SetInsertPoint(bb_xgetbv);
+			auto i32 = builder.getInt32Ty();
+			auto ty_fn = llvm::FunctionType::get(llvm::StructType::get(i32, i32), {i32}, false);
+			auto fn = llvm::InlineAsm::get(ty_fn, "xgetbv", "={ax},={dx},{cx},~{dirflag},~{fpsr},~{flags}", false);
+			std::array<unsigned, 1> indices = {0};
+			auto xcr0_lo = builder.CreateExtractValue(builder.CreateCall(ty_fn, fn, {zero}), indices);
+			builder.CreateBr(bb_done);
+
+			builder.SetInsertPoint(bb_done);
+			auto phi = builder.CreatePHI(i32, 2);
+			phi->addIncoming(zero, bb_entry);
+			phi->addIncoming(xcr0_lo, bb_xgetbv);
+			r[xcr0] = phi;
+
+			return r;
+		}
+	} // namespace
+
+	void multiversion::run(llvm::Module &m, const llvm::Triple &triple) {
+		if(functions.empty()) {
+			return;
+		}
+
+		if(triple.getArch() != llvm::Triple::x86_64 || !triple.isOSBinFormatELF()) {
+			std::ostringstream s;
+			s << "multiversion: unsupported target: " << triple.str();
+			auto str = s.str();
+
+			std::cerr << str << std::endl << std::endl;
+			throw std::runtime_error(s.str());
+		}
+
+		std::vector<const level *> lvls;
+		for(auto &name : levels) {
+			lvls.emplace_back(find_level(name));
+		}
+
+		for(auto &name : functions) {
+			auto f = m.getFunction(name);
+			if(!f || f->isDeclaration()) {
+				continue;
+			}
+
+			// the fallback runs anywhere, whatever the target machine's cpu; an
+			// empty feature string keeps the machine's features off it too
+			f->setName(name + ".default");
+			f->addFnAttr("target-cpu", baseline);
+			f->addFnAttr("target-features", "");
+
+			auto ty_ptr = f->getType();
+			auto resolver = llvm::Function::Create(llvm::FunctionType::get(ty_ptr, false), llvm::GlobalValue::InternalLinkage, name + ".resolver", m);
+			auto ifunc = llvm::GlobalIFunc::create(f->getFunctionType(), ty_ptr->getAddressSpace(), f->getLinkage(), name, resolver, &m);
+			f->replaceAllUsesWith(ifunc);
+			f->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+			auto bb_entry = llvm::BasicBlock::Create(m.getContext(), "entry", resolver);
+			llvm::IRBuilder<> builder(bb_entry);
+
+			auto regs = features(builder);
+
+			// levels are cumulative, so the last one supported wins
+			llvm::Value *r = f;
+			for(auto lvl : lvls) {
+				llvm::ValueToValueMapTy vmap;
+				auto clone = llvm::CloneFunction(f, vmap);
+				clone->setName(name + "." + lvl->name);
+				clone->addFnAttr("target-cpu", lvl->name);
+				clone->addFnAttr("target-features", "");
+
+				llvm::Value *ok = builder.getTrue();
+				for(unsigned i = 0; i < num_regs; ++i) {
+					if(lvl->masks[i] != 0) {
+						auto mask = builder.getInt32(lvl->masks[i]);
+						ok = builder.CreateAnd(ok, builder.CreateICmpEQ(builder.CreateAnd(regs[i], mask), mask));
+					}
+				}
+
+				r = builder.CreateSelect(ok, clone, r);
+			}
+
+			builder.CreateRet(r);
+		}
+	}
+} // namespace etch
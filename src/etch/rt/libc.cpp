@@ -0,0 +1,52 @@
+#include <etch/rt.hpp>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+
+// the runtime's interface on top of libc, for executables that libc's start
+// files enter instead of the bundled runtime, such as instrumented ones; its
+// main runs main = () -> ... and exits through libc, so atexit handlers run
+
+namespace {
+	int argc;
+	char **argv;
+	char **envp;
+} // namespace
+
+extern "C" {
+	int etch_main() __asm__("etch.1.main");
+
+	int etch_rt_argc() {
+		return argc;
+	}
+
+	char ** etch_rt_argv() {
+		return argv;
+	}
+
+	char ** etch_rt_envp() {
+		return envp;
+	}
+
+	long etch_rt_read(int fd, void *buf, unsigned long size) {
+		auto r = ::read(fd, buf, size);
+		return r < 0 ? -errno : r;
+	}
+
+	long etch_rt_write(int fd, const void *buf, unsigned long size) {
+		auto r = ::write(fd, buf, size);
+		return r < 0 ? -errno : r;
+	}
+
+	void etch_rt_exit(int status) {
+		std::exit(status);
+	}
+}
+
+int main(int c, char **v, char **e) {
+	argc = c;
+	argv = v;
+	envp = e;
+
+	etch_rt_exit(etch_main());
+}
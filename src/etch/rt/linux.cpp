@@ -0,0 +1,133 @@
+#include <etch/rt.hpp>
+
+namespace {
+	int argc;
+	char **argv;
+	char **envp;
+
+#if defined(__x86_64__)
+	enum : long {
+		sys_read = 0,
+		sys_write = 1,
+		sys_exit_group = 231
+	};
+
+	enum : unsigned long {
+		r_irelative = 37
+	};
+
+	long syscall3(long n, long a, long b, long c) {
+		long r;
+		__asm__ volatile("syscall" : "=a"(r) : "a"(n), "D"(a), "S"(b), "d"(c) : "rcx", "r11", "memory");
+		return r;
+	}
+#elif defined(__aarch64__)
+	enum : long {
+		sys_read = 63,
+		sys_write = 64,
+		sys_exit_group = 94
+	};
+
+	enum : unsigned long {
+		r_irelative = 1032
+	};
+
+	long syscall3(long n, long a, long b, long c) {
+		register long x8 __asm__("x8") = n;
+		register long x0 __asm__("x0") = a;
+		register long x1 __asm__("x1") = b;
+		register long x2 __asm__("x2") = c;
+		__asm__ volatile("svc 0" : "+r"(x0) : "r"(x8), "r"(x1), "r"(x2) : "memory");
+		return x0;
+	}
+#else
+#error The runtime does not support this architecture
+#endif
+
+	// ifuncs, e.g. from multiversion, are resolved here in a static executable
+	struct rela {
+		unsigned long offset;
+		unsigned long info;
+		long addend;
+	};
+} // namespace
+
+extern "C" {
+	extern const rela __rela_iplt_start[] __attribute__((weak, visibility("hidden")));
+	extern const rela __rela_iplt_end[] __attribute__((weak, visibility("hidden")));
+
+	int etch_main() __asm__("etch.1.main");
+
+	[[noreturn]] void etch_rt_start(long *sp) __asm__("etch.1.etch.rt.start");
+
+	// the kernel leaves argc, argv and envp on the stack; the frame pointer and
+	// return address are cleared to end backtraces here
+#if defined(__x86_64__)
+	__asm__(R"(
+	.text
+	.globl "etch.1.etch.rt.entry"
+	.type "etch.1.etch.rt.entry", @function
+"etch.1.etch.rt.entry":
+	xor %ebp, %ebp
+	mov %rsp, %rdi
+	and $-16, %rsp
+	call "etch.1.etch.rt.start"
+	hlt
+	.size "etch.1.etch.rt.entry", . - "etch.1.etch.rt.entry"
+)");
+#elif defined(__aarch64__)
+	__asm__(R"(
+	.text
+	.globl "etch.1.etch.rt.entry"
+	.type "etch.1.etch.rt.entry", %function
+"etch.1.etch.rt.entry":
+	mov x29, #0
+	mov x30, #0
+	mov x0, sp
+	bl "etch.1.etch.rt.start"
+	brk #0
+	.size "etch.1.etch.rt.entry", . - "etch.1.etch.rt.entry"
+)");
+#endif
+
+	void etch_rt_start(long *sp) {
+		argc = (int)sp[0];
+		argv = (char **)(sp + 1);
+		envp = argv + argc + 1;
+
+		for(auto r = __rela_iplt_start; r < __rela_iplt_end; ++r) {
+			if((r->info & 0xffffffff) == r_irelative) {
+				auto resolver = (unsigned long (*)())r->addend;
+				*(unsigned long *)r->offset = resolver();
+			}
+		}
+
+		etch_rt_exit(etch_main());
+	}
+
+	int etch_rt_argc() {
+		return argc;
+	}
+
+	char ** etch_rt_argv() {
+		return argv;
+	}
+
+	char ** etch_rt_envp() {
+		return envp;
+	}
+
+	long etch_rt_read(int fd, void *buf, unsigned long size) {
+		return syscall3(sys_read, fd, (long)buf, (long)size);
+	}
+
+	long etch_rt_write(int fd, const void *buf, unsigned long size) {
+		return syscall3(sys_write, fd, (long)buf, (long)size);
+	}
+
+	void etch_rt_exit(int status) {
+		for(;;) {
+			syscall3(sys_exit_group, status, 0, 0);
+		}
+	}
+}
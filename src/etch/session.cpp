@@ -0,0 +1,195 @@
+#include <etch/session.hpp>
+#include <boost/asio.hpp>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetOptions.h>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+
+namespace etch {
+	session::lease::~lease() {
+		if(tm) {
+			std::lock_guard<std::mutex> lock(s->mtx);
+			s->idle[key].emplace_back(std::move(tm));
+		}
+	}
+
+	session::session() {
+		static std::once_flag once;
+		std::call_once(once, [] {
+			llvm::InitializeAllTargetInfos();
+			llvm::InitializeAllTargets();
+			llvm::InitializeAllTargetMCs();
+			llvm::InitializeAllAsmPrinters();
+			llvm::InitializeAllAsmParsers();
+		});
+	}
+
+	session & session::shared() {
+		static session s;
+		return s;
+	}
+
+	session::lease session::acquire(const std::string &triple, const std::string &cpu, const std::string &features, llvm::CodeGenOpt::Level level) {
+		std::ostringstream s;
+		s << triple << '\0' << cpu << '\0' << features << '\0' << (int)level;
+		auto key = s.str();
+
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			auto &tms = idle[key];
+			if(!tms.empty()) {
+				auto tm = std::move(tms.back());
+				tms.pop_back();
+				return lease(this, key, std::move(tm));
+			}
+		}
+
+		std::string err;
+		auto target = llvm::TargetRegistry::lookupTarget(triple, err);
+		if(!target) {
+			std::cerr << "ERROR: unknown target: " << triple << std::endl;
+			throw std::runtime_error(err);
+		}
+
+		llvm::TargetOptions opts;
+		std::unique_ptr<llvm::TargetMachine> tm{target->createTargetMachine(triple, cpu, features, opts, {}, {}, level)};
+
+		return lease(this, key, std::move(tm));
+	}
+
+	compiler session::job(std::string name) {
+		compiler c(name);
+		c.sess = this;
+		return c;
+	}
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+	namespace {
+		using socket = boost::asio::local::stream_protocol::socket;
+
+		void respond(socket &sock, uint8_t status, std::string_view payload) {
+			uint64_t size = payload.size();
+			std::array<boost::asio::const_buffer, 3> bufs = {
+				boost::asio::buffer(&status, sizeof(status)),
+				boost::asio::buffer(&size, sizeof(size)),
+				boost::asio::buffer(payload.data(), payload.size())
+			};
+			boost::asio::write(sock, bufs);
+		}
+
+		void handle(session &sess, socket sock) {
+			try {
+				for(;;) {
+					uint8_t header[2];
+					uint64_t size;
+					boost::system::error_code ec;
+					boost::asio::read(sock, boost::asio::buffer(header), ec);
+					if(ec) {
+						// the client is done
+						return;
+					}
+					boost::asio::read(sock, boost::asio::buffer(&size, sizeof(size)));
+
+					if(size > sess.max_request) {
+						// the source is left unread, so the connection cannot go on
+						std::ostringstream s;
+						s << "session: request of " << size << " B exceeds the limit of " << sess.max_request << " B";
+						respond(sock, 1, s.str());
+						return;
+					}
+
+					std::string src(size, '\0');
+					boost::asio::read(sock, boost::asio::buffer(src.data(), src.size()));
+
+					if(header[0] > (uint8_t)compiler::target::bitcode) {
+						respond(sock, 1, "session: unknown target " + std::to_string(header[0]));
+						continue;
+					}
+					if(header[1] > (uint8_t)compiler::opt_level::Oz) {
+						respond(sock, 1, "session: unknown opt level " + std::to_string(header[1]));
+						continue;
+					}
+
+					std::string out;
+					uint8_t status = 0;
+					try {
+						auto c = sess.job();
+						c.tgt = (compiler::target)header[0];
+						c.opt = (compiler::opt_level)header[1];
+						out = c.run(src);
+					} catch(std::exception &e) {
+						status = 1;
+						out = e.what();
+					}
+					respond(sock, status, out);
+				}
+			} catch(std::exception &e) {
+				std::cerr << "ERROR: session: " << e.what() << std::endl;
+			}
+		}
+	} // namespace
+
+	void session::serve(const std::string &path, size_t threads) {
+		using boost::asio::local::stream_protocol;
+
+		// a socket left behind by an earlier daemon would fail the bind;
+		// anything else at the path is left alone and fails it
+		std::error_code ec;
+		if(std::filesystem::is_socket(path, ec)) {
+			std::filesystem::remove(path, ec);
+		}
+
+		boost::asio::io_context io;
+		stream_protocol::acceptor acceptor(io, stream_protocol::endpoint(path));
+		boost::asio::thread_pool pool(threads);
+
+		for(;;) {
+			socket sock(io);
+			acceptor.accept(sock);
+			boost::asio::post(pool, [this, sock = std::move(sock)]() mutable {
+				handle(*this, std::move(sock));
+			});
+		}
+	}
+
+	std::string session::request(const std::string &path, compiler::target tgt, compiler::opt_level opt, std::string_view src) {
+		using boost::asio::local::stream_protocol;
+
+		boost::asio::io_context io;
+		socket sock(io);
+		sock.connect(stream_protocol::endpoint(path));
+
+		uint8_t header[2] = {(uint8_t)tgt, (uint8_t)opt};
+		uint64_t size = src.size();
+		std::array<boost::asio::const_buffer, 3> bufs = {
+			boost::asio::buffer(header),
+			boost::asio::buffer(&size, sizeof(size)),
+			boost::asio::buffer(src.data(), src.size())
+		};
+		boost::asio::write(sock, bufs);
+
+		uint8_t status;
+		boost::asio::read(sock, boost::asio::buffer(&status, sizeof(status)));
+		boost::asio::read(sock, boost::asio::buffer(&size, sizeof(size)));
+
+		std::string out(size, '\0');
+		boost::asio::read(sock, boost::asio::buffer(out.data(), out.size()));
+
+		if(status != 0) {
+			std::cerr << "ERROR: " << out << std::endl;
+			throw std::runtime_error(out);
+		}
+		return out;
+	}
+#else
+	void session::serve(const std::string &, size_t) {
+		throw std::runtime_error("session: Unix domain sockets are not supported on this platform");
+	}
+
+	std::string session::request(const std::string &, compiler::target, compiler::opt_level, std::string_view) {
+		throw std::runtime_error("session: Unix domain sockets are not supported on this platform");
+	}
+#endif
+} // namespace etch
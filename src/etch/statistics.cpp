@@ -0,0 +1,203 @@
+#include <etch/statistics.hpp>
+#include <llvm/Support/Process.h>
+#include <unordered_set>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace etch {
+	namespace {
+		size_t peak_rss() {
+#if defined(_WIN32)
+			PROCESS_MEMORY_COUNTERS pmc;
+			if(GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+				return pmc.PeakWorkingSetSize;
+			}
+			return 0;
+#else
+			struct rusage ru;
+			if(getrusage(RUSAGE_SELF, &ru) != 0) {
+				return 0;
+			}
+#if defined(__APPLE__)
+			return (size_t)ru.ru_maxrss;
+#else
+			return (size_t)ru.ru_maxrss * 1024;
+#endif
+#endif
+		}
+
+		// nodes may be shared, each is counted once
+		class counter {
+			statistics::phase &p;
+			std::unordered_set<const ir::base *> seen;
+
+			template<typename T>
+			void node(const char *kind, size_t extra = 0) {
+				++p.nodes[kind];
+				p.node_bytes += sizeof(T) + extra;
+			}
+		  public:
+			counter(statistics::phase &p) : p(p) {}
+
+			void run(const ir::ptr<ir::base> &val) {
+				if(!val || !seen.insert(val.get()).second) {
+					return;
+				}
+
+				if(ir::is<ir::constant_int>(val)) {
+					node<ir::constant_int>("constant_int");
+				} else if(auto x = ir::as<ir::constant_vec>(val)) {
+					node<ir::constant_vec>("constant_vec", x->vals.capacity() * sizeof(int32_t));
+				} else if(auto x = ir::as<ir::identifier>(val)) {
+					node<ir::identifier>("identifier", x->str.capacity());
+					if(!ir::is<ir::type_unresolved>(x->type())) {
+						run(x->type());
+					}
+				} else if(auto x = ir::as<ir::call>(val)) {
+					node<ir::call>("call");
+					run(x->fn);
+					run(x->arg);
+				} else if(auto x = ir::as<ir::definition>(val)) {
+					node<ir::definition>("definition");
+					run(x->binding);
+					run(x->val);
+				} else if(auto x = ir::as<ir::tuple>(val)) {
+					node<ir::tuple>("tuple", x->vals.capacity() * sizeof(ir::ptr<ir::base>));
+					for(auto &v : x->vals) {
+						run(v);
+					}
+				} else if(auto x = ir::as<ir::block>(val)) {
+					node<ir::block>("block", x->vals.capacity() * sizeof(ir::ptr<ir::base>));
+					for(auto &v : x->vals) {
+						run(v);
+					}
+				} else if(auto x = ir::as<ir::function>(val)) {
+					node<ir::function>("function");
+					run(x->arg);
+					run(x->body);
+				} else if(auto x = ir::as<ir::module_>(val)) {
+					node<ir::module_>("module", x->defs.capacity() * sizeof(ir::ptr<ir::base>));
+					for(auto &v : x->defs) {
+						run(v);
+					}
+				} else if(auto x = ir::as<ir::cast>(val)) {
+					node<ir::cast>("cast");
+					run(x->ty);
+					run(x->val);
+				} else if(auto x = ir::as<ir::type_vec>(val)) {
+					node<ir::type_vec>("type_vec");
+					run(x->el);
+				} else if(ir::is<ir::type_int>(val)) {
+					node<ir::type_int>("type_int");
+				} else if(ir::is<ir::type_type>(val)) {
+					node<ir::type_type>("type_type");
+				} else if(ir::is<ir::type_unresolved>(val)) {
+					node<ir::type_unresolved>("type_unresolved");
+				} else {
+					// intrinsics carry no state
+					node<ir::intr_int>("intrinsic");
+				}
+			}
+		};
+
+		void json_string(std::ostream &s, const std::string &str) {
+			s << '"';
+			for(auto c : str) {
+				if(c == '"' || c == '\\') {
+					s << '\\';
+				}
+				s << c;
+			}
+			s << '"';
+		}
+	} // namespace
+
+	statistics::phase & statistics::record(std::string name) {
+		phase p;
+		p.name = name;
+		p.heap = llvm::sys::Process::GetMallocUsage();
+		p.peak_rss = peak_rss();
+		phases.emplace_back(p);
+		return phases.back();
+	}
+
+	void statistics::merge(const statistics &o) {
+		phases.insert(phases.end(), o.phases.begin(), o.phases.end());
+	}
+
+	void statistics::count(phase &p, const ir::unit &au) {
+		counter c(p);
+		for(auto &am : au.modules) {
+			c.run(am);
+		}
+	}
+
+	void statistics::count(phase &p, const llvm::Module &m) {
+		p.globals = m.global_size();
+		p.functions = 0;
+		p.blocks = 0;
+		p.instructions = 0;
+		for(auto &f : m) {
+			if(f.isDeclaration()) {
+				continue;
+			}
+			++p.functions;
+			for(auto &bb : f) {
+				++p.blocks;
+				p.instructions += bb.size();
+			}
+		}
+	}
+
+	std::ostream & statistics::dump(std::ostream &s) const {
+		for(auto &p : phases) {
+			s << p.name << ": heap " << p.heap << " B, peak rss " << p.peak_rss << " B" << std::endl;
+			if(!p.nodes.empty()) {
+				size_t total = 0;
+				for(auto &[kind, n] : p.nodes) {
+					total += n;
+				}
+				s << "  nodes " << total << " (" << p.node_bytes << " B)";
+				for(auto &[kind, n] : p.nodes) {
+					s << ", " << kind << ' ' << n;
+				}
+				s << std::endl;
+			}
+			if(p.visited) {
+				s << "  visited " << p.visited << ", rewritten " << p.rewritten << std::endl;
+			}
+			if(p.functions || p.globals) {
+				s << "  globals " << p.globals << ", functions " << p.functions << ", blocks " << p.blocks << ", instructions " << p.instructions << std::endl;
+			}
+		}
+		return s;
+	}
+
+	std::ostream & statistics::json(std::ostream &s) const {
+		s << "{\"phases\":[";
+		for(size_t i = 0; i < phases.size(); ++i) {
+			auto &p = phases[i];
+			s << (i ? "," : "") << "{\"name\":";
+			json_string(s, p.name);
+			s << ",\"heap\":" << p.heap << ",\"peak_rss\":" << p.peak_rss;
+			s << ",\"nodes\":{";
+			bool first = true;
+			for(auto &[kind, n] : p.nodes) {
+				s << (first ? "" : ",");
+				json_string(s, kind);
+				s << ':' << n;
+				first = false;
+			}
+			s << "},\"node_bytes\":" << p.node_bytes;
+			s << ",\"visited\":" << p.visited << ",\"rewritten\":" << p.rewritten;
+			s << ",\"globals\":" << p.globals << ",\"functions\":" << p.functions;
+			s << ",\"blocks\":" << p.blocks << ",\"instructions\":" << p.instructions << '}';
+		}
+		return s << "]}";
+	}
+} // namespace etch
@@ -0,0 +1,76 @@
+// etch-test-abi: tuples are flattened into scalar parameters and registers
+// up to the configured limits and passed through memory beyond them
+
+#include "check.hpp"
+#include <etch/compiler.hpp>
+#include <cstdint>
+#include <string>
+
+namespace {
+	using namespace etch::test;
+
+	const std::string src =
+		"flat = (a, b, c) -> a + b * c\n"
+		"nested = ((a, b), c) -> a + b * c\n"
+		"pair = a -> (a, a + 1)\n"
+		"triple = a -> (a, a + 1, a + 2)\n"
+		"deep = a -> (a, (a + 1, a + 2))\n"
+		"wide = (a, b, c, d, e, f, g) -> a + b + c + d + e + f + g\n"
+		"main = () -> {\n"
+		"	(x, (y, z)) = deep <- 1\n"
+		"	(u, v, w) = triple <- (nested <- ((x, y), z))\n"
+		"	(p, q) = pair <- (flat <- (u, v, w))\n"
+		"	wide <- (p, q, 1, 2, 3, 4, 5)\n"
+		"}\n";
+
+	std::string assembly(const etch::codegen::options &opts) {
+		etch::compiler c;
+		c.tgt = etch::compiler::target::llvm_assembly;
+		c.opt = etch::compiler::opt_level::O0;
+		c.cg_opts = opts;
+		return c.run(src);
+	}
+
+	int32_t evaluate(const etch::codegen::options &opts) {
+		etch::jit j;
+		etch::compiler c;
+		c.cg_opts = opts;
+		c.run(src, j);
+		return j.lookup<int32_t()>({"main"})();
+	}
+} // namespace
+
+int main() {
+	etch::codegen::options opts;
+
+	// small tuples, nested ones included, become scalar parameters
+	{
+		auto ir = assembly(opts);
+		CHECK(contains(ir, "i32 @etch.1.flat(i32 %0, i32 %1, i32 %2)"));
+		CHECK(contains(ir, "i32 @etch.1.nested(i32 %0, i32 %1, i32 %2)"));
+		CHECK(contains(ir, "{ i32, i32 } @etch.1.pair(i32 %0)"));
+
+		// larger results go through sret, keeping their nesting
+		CHECK(contains(ir, "void @etch.1.triple({ i32, i32, i32 }* noalias nocapture sret({ i32, i32, i32 }) %0, i32 %1)"));
+		CHECK(contains(ir, "void @etch.1.deep({ i32, { i32, i32 } }* noalias nocapture sret({ i32, { i32, i32 } }) %0, i32 %1)"));
+
+		// and larger arguments by readonly pointer
+		CHECK(contains(ir, "i32 @etch.1.wide({ i32, i32, i32, i32, i32, i32, i32 }* noalias nocapture readonly %0)"));
+
+		CHECK(evaluate(opts) == 174);
+	}
+
+	// the limits move the same functions to the other conventions
+	opts.abi_flat_args = 2;
+	opts.abi_direct_ret = 3;
+	{
+		auto ir = assembly(opts);
+		CHECK(contains(ir, "i32 @etch.1.flat({ i32, i32, i32 }* noalias nocapture readonly %0)"));
+		CHECK(contains(ir, "{ i32, i32, i32 } @etch.1.triple(i32 %0)"));
+		CHECK(contains(ir, "{ i32, i32, i32 } @etch.1.deep(i32 %0)"));
+
+		CHECK(evaluate(opts) == 174);
+	}
+
+	return result();
+}
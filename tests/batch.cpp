@@ -0,0 +1,62 @@
+// etch-test-batch: every input is compiled and delivered once, failures are
+// reported per input, and an exception from the callback reaches the caller
+// without leaving the byte budget taken
+
+#include "check.hpp"
+#include <etch/batch.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+	using namespace etch::test;
+
+	std::vector<etch::batch_input> inputs() {
+		std::vector<etch::batch_input> r;
+		for(size_t i = 0; i < 8; ++i) {
+			r.push_back({"b" + std::to_string(i) + ".e", "main = () -> " + std::to_string(i) + "\n"});
+		}
+		r.push_back({"bad.e", "i8 = #int <- 8\nf = (a : i8) -> a\nmain = () -> f <- (1 : #int <- 16)\n"});
+		return r;
+	}
+} // namespace
+
+int main() {
+	etch::compiler proto;
+	proto.tgt = etch::compiler::target::llvm_assembly;
+	auto in = inputs();
+
+	// every input once, with its error if it failed to compile
+	{
+		std::vector<int> seen(in.size());
+		size_t errors = 0;
+		etch::compile_batch(in, proto, 2, [&](etch::batch_result r) {
+			++seen[r.index];
+			if(r.error) {
+				++errors;
+				CHECK(in[r.index].name == "bad.e");
+			} else {
+				CHECK(contains(r.output, in[r.index].name));
+			}
+		});
+		CHECK(std::count(seen.begin(), seen.end(), 1) == (long)in.size());
+		CHECK(errors == 1);
+	}
+
+	// a budget of one input at a time would never be given back if the
+	// throwing callback kept it
+	{
+		size_t calls = 0;
+		auto what = error([&] {
+			etch::compile_batch(in, proto, 2, [&](etch::batch_result) {
+				++calls;
+				throw std::runtime_error("done failed");
+			}, 1);
+		});
+		CHECK(what == "done failed");
+		CHECK(calls == 1);
+	}
+
+	return result();
+}
@@ -0,0 +1,133 @@
+// etch-test-cache: entries survive a round trip through the directory, failed
+// writes leave nothing behind, and stale temporary files and the least
+// recently used entries are pruned
+
+#include "check.hpp"
+#include <etch/cache.hpp>
+#include <etch/compiler.hpp>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+	using namespace etch::test;
+
+	size_t count(const fs::path &dir, const std::string &prefix) {
+		size_t n = 0;
+		for(auto &e : fs::directory_iterator(dir)) {
+			if(e.path().filename().string().compare(0, prefix.size(), prefix) == 0) {
+				++n;
+			}
+		}
+		return n;
+	}
+
+	// writes past the file size limit fail with EFBIG instead of a signal
+	class size_limit {
+		rlimit old;
+	  public:
+		size_limit(rlim_t bytes) {
+			std::signal(SIGXFSZ, SIG_IGN);
+			getrlimit(RLIMIT_FSIZE, &old);
+			rlimit l = old;
+			l.rlim_cur = bytes;
+			setrlimit(RLIMIT_FSIZE, &l);
+		}
+		~size_limit() {
+			setrlimit(RLIMIT_FSIZE, &old);
+			std::signal(SIGXFSZ, SIG_DFL);
+		}
+	};
+} // namespace
+
+int main() {
+	auto dir = fs::temp_directory_path() / ("etch-test-cache-" + std::to_string(getpid()));
+	fs::remove_all(dir);
+
+	// round trip
+	{
+		etch::cache c(dir.string());
+		CHECK(!c.get("a"));
+		c.put("a", std::string("one\0two", 7));
+		auto a = c.get("a");
+		CHECK(a && *a == std::string("one\0two", 7));
+		CHECK(count(dir, "tmp-") == 0);
+	}
+
+	// a write that fails, either while writing or only once the buffered
+	// data is flushed on close, stores no entry and leaves no temporary file
+	{
+		etch::cache c(dir.string());
+		{
+			size_limit limit(100);
+			c.put("flushed", std::string(500, 'x'));
+			c.put("written", std::string(size_t(1) << 20, 'x'));
+		}
+		CHECK(!c.get("flushed"));
+		CHECK(!c.get("written"));
+		CHECK(count(dir, "tmp-") == 0);
+	}
+
+	// temporary files of writers that died are removed once stale
+	{
+		etch::cache c(dir.string());
+		std::ofstream(dir / "tmp-old") << "old";
+		std::ofstream(dir / "tmp-new") << "new";
+		fs::last_write_time(dir / "tmp-old", fs::file_time_type::clock::now() - std::chrono::hours(2));
+		c.put("b", "b");
+		CHECK(!fs::exists(dir / "tmp-old"));
+		CHECK(fs::exists(dir / "tmp-new"));
+		fs::remove(dir / "tmp-new");
+	}
+
+	// the least recently used entries go once the limit is exceeded, and the
+	// directory is only scanned for that when this cache's writes may have
+	// exceeded it
+	{
+		auto lru = dir / "lru";
+		etch::cache c(lru.string(), 250);
+		c.put("c", std::string(100, 'c'));
+		fs::last_write_time(lru / "etch-c", fs::file_time_type::clock::now() - std::chrono::hours(2));
+		std::ofstream(lru / "tmp-old") << "old";
+		fs::last_write_time(lru / "tmp-old", fs::file_time_type::clock::now() - std::chrono::hours(2));
+		c.put("d", std::string(100, 'd'));
+		CHECK(fs::exists(lru / "tmp-old"));
+		c.put("e", std::string(100, 'e'));
+		CHECK(!fs::exists(lru / "tmp-old"));
+		CHECK(!c.get("c"));
+		CHECK(c.get("d").has_value());
+		CHECK(c.get("e").has_value());
+	}
+
+	// the compiler stores its output once and reuses it
+	{
+		auto objects = std::make_shared<etch::cache>((dir / "objects").string());
+		std::string outputs[2];
+		for(auto &out : outputs) {
+			etch::compiler c;
+			c.tgt = etch::compiler::target::assembly;
+			c.objects = objects;
+			out = c.run("main = () -> 1\n");
+		}
+		CHECK(!outputs[0].empty());
+		CHECK(outputs[0] == outputs[1]);
+		CHECK(count(dir / "objects", "etch-") == 1);
+
+		// the module name is part of the output
+		etch::compiler c("b.e");
+		c.tgt = etch::compiler::target::assembly;
+		c.objects = objects;
+		CHECK(contains(c.run("main = () -> 1\n"), "b.e"));
+		CHECK(count(dir / "objects", "etch-") == 2);
+	}
+
+	fs::remove_all(dir);
+	return result();
+}
@@ -0,0 +1,41 @@
+#ifndef ETCH_TESTS_CHECK_HPP
+#define ETCH_TESTS_CHECK_HPP 1
+
+#include <exception>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+namespace etch::test {
+	inline int failures = 0;
+
+	inline void check(bool ok, const char *what, const char *file, int line) {
+		if(!ok) {
+			std::cerr << file << ':' << line << ": check failed: " << what << std::endl;
+			++failures;
+		}
+	}
+
+	// message of the exception thrown by f, empty if it returned
+	template<typename F>
+	std::string error(F f) {
+		try {
+			f();
+		} catch(const std::exception &e) {
+			return e.what();
+		}
+		return "";
+	}
+
+	inline bool contains(std::string_view s, std::string_view part) {
+		return s.find(part) != std::string_view::npos;
+	}
+
+	inline int result() {
+		return failures ? 1 : 0;
+	}
+} // namespace etch::test
+
+#define CHECK(...) etch::test::check((__VA_ARGS__), #__VA_ARGS__, __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,34 @@
+// etch-test-entry: the runtimes call main without arguments and exit with
+// its i32 result, so any other main is rejected before it reaches them
+
+#include "check.hpp"
+#include <etch/compiler.hpp>
+#include <string>
+
+namespace {
+	using namespace etch::test;
+
+	std::string failure(const std::string &src) {
+		return error([&] {
+			etch::compiler c;
+			c.tgt = etch::compiler::target::llvm_assembly;
+			c.opt = etch::compiler::opt_level::O0;
+			c.run("i8 = #int <- 8\n" + src);
+		});
+	}
+} // namespace
+
+int main() {
+	CHECK(failure("main = () -> 0\n").empty());
+	CHECK(failure("f = () -> 1\nmain = f\n").empty());
+
+	CHECK(contains(failure("main = x -> x\n"), "main must be () -> i32"));
+	CHECK(contains(failure("main = () -> (1, 2)\n"), "main must be () -> i32"));
+	CHECK(contains(failure("main = () -> 0 : i8\n"), "main must be () -> i32"));
+	CHECK(contains(failure("main = 3\n"), "main must be () -> i32"));
+
+	// only the top-level main is an entry point
+	CHECK(failure("f = x -> { main = (a, b) -> a  main <- (x, 1) }\nmain = () -> f <- 1\n").empty());
+
+	return result();
+}
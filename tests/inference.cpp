@@ -0,0 +1,83 @@
+// etch-test-inference: types inferred across calls and lane operations, and
+// the diagnostics for programs that cannot be typed
+
+#include "check.hpp"
+#include <etch/compiler.hpp>
+#include <cstdint>
+#include <string>
+
+namespace {
+	using namespace etch::test;
+
+	std::string assembly(const std::string &src) {
+		etch::compiler c;
+		c.tgt = etch::compiler::target::llvm_assembly;
+		c.opt = etch::compiler::opt_level::O0;
+		return c.run(src);
+	}
+
+	std::string failure(const std::string &src) {
+		return error([&] {
+			assembly(src);
+		});
+	}
+} // namespace
+
+int main() {
+	// an untyped literal takes the parameter type found two calls down
+	{
+		auto ir = assembly(
+			"i8 = #int <- 8\n"
+			"f = (a : i8) -> a * 3 + 1\n"
+			"g = a -> f <- a\n"
+			"h = b -> g <- b\n"
+			"main = () -> { x = h <- 2  0 }\n");
+		CHECK(contains(ir, "define internal fastcc i8 @etch.1.g(i8"));
+		CHECK(contains(ir, "define internal fastcc i8 @etch.1.h(i8"));
+		CHECK(contains(ir, "call fastcc i8 @etch.1.h(i8 2)"));
+	}
+
+	// lane operations on parameters take the vector type of the argument
+	{
+		std::string src =
+			"i32 = #int <- 32\n"
+			"v4 = #vec <- (i32, 4)\n"
+			"lane = v -> #extract <- (v, 3)\n"
+			"swap = v -> #shuffle <- (v, v, (3, 2, 1, 0))\n"
+			"main = () -> lane <- (swap <- ((1, 2, 3, 4) : v4))\n";
+		auto ir = assembly(src);
+		CHECK(contains(ir, "define internal fastcc i32 @etch.1.lane(<4 x i32>"));
+		CHECK(contains(ir, "define internal fastcc <4 x i32> @etch.1.swap(<4 x i32>"));
+
+		etch::jit j;
+		etch::compiler c;
+		c.run(src, j);
+		CHECK(j.lookup<int32_t()>({"main"})() == 1);
+	}
+
+	// mismatched integer widths name both types
+	CHECK(contains(failure(
+		"i8 = #int <- 8\n"
+		"i16 = #int <- 16\n"
+		"f = (a : i8) -> a\n"
+		"main = () -> f <- (1 : i16)\n"), "cannot unify (type_int 8) with (type_int 16)"));
+
+	// self-application would need a cyclic type and is rejected
+	CHECK(contains(failure(
+		"f = x -> x <- x\n"
+		"main = () -> 0\n"), "would contain itself"));
+
+	// lane operations whose vector type is never fixed
+	CHECK(contains(failure(
+		"lane = v -> #extract <- (v, 3)\n"
+		"main = () -> 0\n"), "cannot infer the vector type of a lane operation"));
+
+	// shuffle masks must be tuples of constant lanes
+	CHECK(contains(failure(
+		"i32 = #int <- 32\n"
+		"v4 = #vec <- (i32, 4)\n"
+		"f = ((v : v4), k) -> #shuffle <- (v, v, (k, 0))\n"
+		"main = () -> 0\n"), "shuffle mask is not a tuple of constant lanes"));
+
+	return result();
+}
@@ -0,0 +1,72 @@
+// etch-test-mangling: demangle inverts mangle and rejects anything else, and
+// the symbol tree builds the same names, numbering anonymous scopes per parent
+
+#include "check.hpp"
+#include <etch/mangling.hpp>
+#include <string>
+#include <vector>
+
+namespace {
+	using namespace etch::test;
+
+	bool round_trip(const std::vector<std::string> &path) {
+		auto r = etch::demangle(etch::mangle(path));
+		return r && *r == path;
+	}
+} // namespace
+
+int main() {
+	CHECK(etch::mangle({}) == "etch.1");
+	CHECK(etch::mangle({"a", "bc"}) == "etch.1.a.bc");
+
+	CHECK(round_trip({}));
+	CHECK(round_trip({"main"}));
+	CHECK(round_trip({"etch", "rt", "entry"}));
+	CHECK(round_trip({"f", "0", "g", "12"}));
+
+	// foreign names and malformed paths
+	CHECK(!etch::demangle("main"));
+	CHECK(!etch::demangle("etch"));
+	CHECK(!etch::demangle("etch.10.a"));
+	CHECK(!etch::demangle("etch.1."));
+	CHECK(!etch::demangle("etch.1..a"));
+	CHECK(!etch::demangle("etch.1.a."));
+
+	etch::symbol root;
+	CHECK(root.root());
+	CHECK(root.str() == "etch.1");
+
+	// a scope is entered once, however often it is asked for
+	auto f = root.child("f");
+	CHECK(f == root.child("f"));
+	CHECK(f->up() == &root);
+	CHECK(!f->root());
+	CHECK(f->str() == etch::mangle({"f"}));
+
+	// anonymous scopes count within their own parent
+	auto f0 = f->anonymous();
+	auto f1 = f->anonymous();
+	auto g0 = root.child("g")->anonymous();
+	CHECK(f0->str() == "etch.1.f.0");
+	CHECK(f1->str() == "etch.1.f.1");
+	CHECK(g0->str() == "etch.1.g.0");
+	CHECK(f0->anonymous()->str() == "etch.1.f.0.0");
+	CHECK(f1->up() == f);
+
+	// their numbers are ordinary names of the path
+	CHECK(f->child("0") == f0);
+	CHECK(etch::demangle(f1->str()) == std::vector<std::string>{"f", "1"});
+
+	// names stay valid as their parent grows
+	std::vector<etch::symbol *> many;
+	for(size_t i = 0; i < 1000; ++i) {
+		many.push_back(f->child("s" + std::to_string(i)));
+	}
+	for(size_t i = 0; i < many.size(); ++i) {
+		auto name = "s" + std::to_string(i);
+		CHECK(f->child(name) == many[i]);
+		CHECK(many[i]->str() == "etch.1.f." + name);
+	}
+
+	return result();
+}
@@ -0,0 +1,74 @@
+// etch-test-merge: structurally identical functions share one body, named
+// duplicates becoming aliases of it, and nothing else is merged
+
+#include "check.hpp"
+#include <etch/compiler.hpp>
+#include <cstdint>
+#include <string>
+
+namespace {
+	using namespace etch::test;
+
+	const std::string src =
+		"i8 = #int <- 8\n"
+		"k = 7\n"
+		"l = 7\n"
+		"f = a -> a * k\n"
+		"g = b -> b * k\n"
+		"h = a -> a * l\n"
+		"n = (a : i8) -> a * 3\n"
+		"o = a -> a * 3\n"
+		"u = x -> (y -> y * k) <- (x + 1)\n"
+		"main = () -> u <- (o <- (h <- (g <- (f <- 1))))\n";
+
+	std::string assembly(bool merge) {
+		etch::compiler c;
+		c.tgt = etch::compiler::target::llvm_assembly;
+		c.opt = etch::compiler::opt_level::O0;
+		c.cg_opts.merge_functions = merge;
+		return c.run(src);
+	}
+
+	int32_t evaluate(bool merge) {
+		etch::jit j;
+		etch::compiler c;
+		c.cg_opts.merge_functions = merge;
+		c.run(src, j);
+		return j.lookup<int32_t()>({"main"})();
+	}
+} // namespace
+
+int main() {
+	{
+		auto ir = assembly(true);
+
+		// names of bound variables do not matter
+		CHECK(contains(ir, "@etch.1.g = internal alias i32 (i32), i32 (i32)* @etch.1.f"));
+		CHECK(!contains(ir, "define internal i32 @etch.1.g("));
+
+		// free names are the symbols they refer to, not their values
+		CHECK(contains(ir, "@etch.1.h("));
+		CHECK(!contains(ir, "@etch.1.h = "));
+
+		// types are part of the structure
+		CHECK(contains(ir, "i8 @etch.1.n(i8"));
+		CHECK(contains(ir, "i32 @etch.1.o(i32"));
+
+		// an anonymous function reuses the named one
+		CHECK(!contains(ir, "@etch.1.u.0"));
+		CHECK(contains(ir, "call i32 @etch.1.f(i32 %1)"));
+
+		CHECK(evaluate(true) == 7210);
+	}
+
+	{
+		auto ir = assembly(false);
+		CHECK(!contains(ir, "alias"));
+		CHECK(contains(ir, "@etch.1.g(i32"));
+		CHECK(contains(ir, "@etch.1.u.0(i32"));
+
+		CHECK(evaluate(false) == 7210);
+	}
+
+	return result();
+}
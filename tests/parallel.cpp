@@ -0,0 +1,89 @@
+// etch-test-parallel: codegen split into parts produces the module serial
+// codegen does, up to the order of its globals
+
+#include "check.hpp"
+#include <etch/compiler.hpp>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+	using namespace etch::test;
+
+	// constants used across parts, functions merged across parts, both at
+	// the top level and nested, aliases and tuples
+	const std::string src =
+		"k = 7\n"
+		"f = a -> a * k\n"
+		"g = a -> a * k\n"
+		"h = b -> (c -> c + 1) <- (b + k)\n"
+		"j = b -> (c -> c + 1) <- b\n"
+		"m = c -> c + 1\n"
+		"n = f\n"
+		"p = (x, y) -> (x + k, y * k)\n"
+		"q = (x, y) -> (x + k, y * k)\n"
+		"r = (x, y) -> p <- (q <- (x, y))\n"
+		"main = () -> n <- (j <- (h <- (m <- (g <- 1))))\n";
+
+	template<typename L>
+	void sort(L &list) {
+		std::vector<decltype(&*list.begin())> vals;
+		for(auto &val : list) {
+			vals.emplace_back(&val);
+		}
+		std::sort(vals.begin(), vals.end(), [](auto a, auto b) {
+			return a->getName() < b->getName();
+		});
+		for(auto val : vals) {
+			list.splice(list.end(), list, val->getIterator());
+		}
+	}
+
+	std::string compile(size_t threads, bool merge) {
+		etch::compiler c;
+		c.tgt = etch::compiler::target::llvm_assembly;
+		c.opt = etch::compiler::opt_level::O0;
+		c.threads = threads;
+		c.cg_opts.merge_functions = merge;
+		return c.run(src);
+	}
+
+	// the module with its globals sorted by name
+	std::string canonical(const std::string &ll) {
+		llvm::LLVMContext ctx;
+		llvm::SMDiagnostic err;
+		auto m = llvm::parseAssemblyString(ll, err, ctx);
+		if(!m) {
+			return "";
+		}
+
+		sort(m->getGlobalList());
+		sort(m->getFunctionList());
+		sort(m->getAliasList());
+
+		std::string s;
+		llvm::raw_string_ostream os(s);
+		m->print(os, nullptr);
+		return os.str();
+	}
+} // namespace
+
+int main() {
+	for(auto merge : {true, false}) {
+		auto serial = canonical(compile(1, merge));
+		CHECK(!serial.empty());
+		// constants are folded into their uses rather than loaded
+		CHECK(!contains(serial, "load"));
+
+		for(size_t threads : {2, 3, 4}) {
+			CHECK(canonical(compile(threads, merge)) == serial);
+		}
+	}
+
+	return result();
+}
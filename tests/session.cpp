@@ -0,0 +1,78 @@
+// etch-test-session: the compile daemon rejects malformed requests with an
+// error response and never removes anything but a socket at its path
+
+#include "check.hpp"
+#include <etch/session.hpp>
+#include <boost/asio/detail/config.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+int main() {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+	using namespace etch::test;
+	using etch::compiler;
+
+	auto dir = fs::temp_directory_path() / ("etch-test-session-" + std::to_string(getpid()));
+	fs::remove_all(dir);
+	fs::create_directories(dir);
+
+	etch::session s;
+	s.max_request = 256;
+
+	// a regular file at the path fails the bind and is kept
+	{
+		auto file = (dir / "file").string();
+		std::ofstream(file) << "keep";
+		CHECK(!error([&] {
+			s.serve(file);
+		}).empty());
+		std::string kept;
+		std::ifstream(file) >> kept;
+		CHECK(kept == "keep");
+	}
+
+	auto path = (dir / "etch.sock").string();
+	std::thread([&] {
+		s.serve(path, 2);
+	}).detach();
+
+	auto request = [&](compiler::target tgt, compiler::opt_level opt, std::string_view src) {
+		return error([&] {
+			etch::session::request(path, tgt, opt, src);
+		});
+	};
+
+	// wait for the daemon to accept, then check that a valid request works
+	std::string err;
+	for(int i = 0; i < 500; ++i) {
+		err = request(compiler::target::llvm_assembly, compiler::opt_level::O0, "main = () -> 1\n");
+		if(err.empty()) {
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	CHECK(err.empty());
+
+	CHECK(contains(request((compiler::target)7, compiler::opt_level::O2, "main = () -> 1\n"), "unknown target 7"));
+	CHECK(contains(request(compiler::target::binary, (compiler::opt_level)9, "main = () -> 1\n"), "unknown opt level 9"));
+	CHECK(contains(request(compiler::target::binary, compiler::opt_level::O2, std::string(1000, ' ')), "exceeds the limit of 256 B"));
+
+	// the daemon still serves after rejecting requests
+	CHECK(request(compiler::target::llvm_assembly, compiler::opt_level::O0, "main = () -> 1\n").empty());
+
+	fs::remove_all(dir);
+
+	// serve() does not return, so leave without unwinding its thread
+	std::cerr.flush();
+	std::_Exit(result());
+#else
+	return 0;
+#endif
+}
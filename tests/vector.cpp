@@ -0,0 +1,55 @@
+// etch-test-vector: lane operations on constants fold away, lane literals
+// must fit their element width, and malformed lane operations are reported
+
+#include "check.hpp"
+#include <etch/compiler.hpp>
+#include <string>
+
+namespace {
+	using namespace etch::test;
+
+	const std::string types =
+		"i8 = #int <- 8\n"
+		"i32 = #int <- 32\n"
+		"b4 = #vec <- (i8, 4)\n"
+		"v4 = #vec <- (i32, 4)\n";
+
+	std::string assembly(const std::string &src) {
+		etch::compiler c;
+		c.tgt = etch::compiler::target::llvm_assembly;
+		c.opt = etch::compiler::opt_level::O0;
+		return c.run(types + src);
+	}
+
+	std::string folded(const std::string &body) {
+		return assembly("main = () -> " + body + "\n");
+	}
+
+	std::string failure(const std::string &src) {
+		return error([&] {
+			assembly(src);
+		});
+	}
+} // namespace
+
+int main() {
+	// every lane intrinsic folds when its operands are constant
+	CHECK(contains(folded("#extract <- (#shuffle <- ((1, 2, 3, 4) : v4, (5, 6, 7, 8) : v4, (7, 0, 5, 2)), 0)"), "ret i32 8"));
+	CHECK(contains(folded("#extract <- (((1, 2, 3, 4) : v4) + ((10, 20, 30, 40) : v4), 3)"), "ret i32 44"));
+	CHECK(contains(folded("#extract <- (#insert <- ((1, 2, 3, 4) : v4, 2, 9), 2)"), "ret i32 9"));
+	CHECK(contains(folded("#extract <- (5 : v4, 3)"), "ret i32 5"));
+
+	// lane literals may be signed or unsigned within the element width
+	CHECK(contains(assembly("f = () -> (-128, 255, 0, -1) : b4\nmain = () -> 0\n"), "<4 x i8> <i8 -128, i8 -1, i8 0, i8 -1>"));
+	CHECK(contains(failure("main = () -> { v = (1, 2, 3, 300) : b4  0 }\n"), "lane literal does not fit the lanes"));
+	CHECK(contains(failure("main = () -> { v = -129 : b4  0 }\n"), "lane literal does not fit the lanes"));
+	CHECK(contains(failure("main = () -> { v = #insert <- ((1, 2, 3, 4) : b4, 1, 256)  0 }\n"), "inserted literal does not fit the lanes"));
+
+	// lane operations codegen cannot lower
+	CHECK(contains(failure("f = (v : v4) -> #insert <- (v, 0)\nmain = () -> 0\n"), "wrong number of operands"));
+	CHECK(contains(failure("f = (v : v4) -> #extract <- (v, 7)\nmain = () -> 0\n"), "lane out of range"));
+	CHECK(contains(failure("f = (v : v4) -> #shuffle <- (v, v, (0, 9))\nmain = () -> 0\n"), "shuffle lane out of range"));
+	CHECK(contains(failure("f = a -> (a, a, a) : v4\nmain = () -> #extract <- (f <- 1, 0)\n"), "tuple does not match the vector's lanes"));
+
+	return result();
+}